@@ -15,15 +15,37 @@
 #ifndef MLIB_LOGGER_HPP
 #define MLIB_LOGGER_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
-#include <iomanip> // IWYU pragma: keep
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fmt/compile.h>
 #include <fmt/format.h>
-#include <fmt/ostream.h>
-#include "details/File.hpp"
+#include "Sinks.hpp"
+#include "details/BinaryFormat.hpp"
+#include "details/BoundedQueue.hpp"
 #include "details/ConsoleColor.hpp"
+#include "details/FlightRecorder.hpp"
+#include "details/FmtTraits.hpp"
+#include "details/JsonFormat.hpp"
+#include "details/LogContext.hpp"
+#include "details/LogType.hpp"
+#include "details/RateLimiter.hpp"
+#include "details/Rcu.hpp"
+#include "details/RepeatFilter.hpp"
+#include "details/SiteRegistry.hpp"
 #include "details/SourcePosition.hpp"
+#include "details/Stats.hpp"
+#include "details/Timestamp.hpp"
+#include "details/TscClock.hpp"
 #include "details/ErrorCode.hpp"
 
 namespace mlib {
@@ -36,186 +58,2364 @@ namespace mlib {
  * It is possible to create local instances of Logger
  * or one can use a singleton global logger.
  *
+ * By default records are written synchronously by the calling thread.
+ * After EnableAsync() producers only format the message into a slot
+ * of a lock-free queue and a background thread writes the records.
+ *
+ * In binary output format only a call site id, the raw time
+ * and the argument bytes are written per record,
+ * the strings of a site are written once per file.
+ *
+ * Records go to the log file set with SetLogFile and to every sink
+ * added with AddSink. A record is formatted once for all of them.
+ * The sinks are published as one set read without locks,
+ * replaced sinks are closed once no thread uses them.
+ *
  */
 class Logger
 {
-    using TimePoint = std::chrono::system_clock::time_point;
+    using TimePoint     = std::chrono::system_clock::time_point;
+    using RuntimeFormat = decltype(fmt::runtime(std::string_view{}));
 public:
-    enum LogType
+    /// Ordered by severity, @see SetLevel
+    using LogType = detail::LogType;
+
+    static constexpr LogType DEBUG = detail::DEBUG;
+    static constexpr LogType INFO  = detail::INFO;
+    static constexpr LogType ERROR = detail::ERROR;
+
+    /** @enum OutputFormat
+     * @brief What the log file contains
+     */
+    enum class OutputFormat
+    {
+        TEXT,   ///< human readable records
+        BINARY, ///< @see details/BinaryFormat.hpp
+        JSON,   ///< one JSON object per line, @see details/JsonFormat.hpp
+    };
+
+    /** @enum OverflowPolicy
+     * @brief What a Log call does when the async queue is full
+     */
+    enum class OverflowPolicy
+    {
+        BLOCK,            ///< waits for a free slot, nothing is lost
+        DROP,             ///< drops the new record
+        OVERWRITE_OLDEST, ///< drops the oldest queued record to make room
+    };
+
+    using TimestampPrecision = detail::TimestampPrecision;
+    using ColorMode          = detail::ColorMode;
+    using Stats              = detail::StatsSnapshot;
+
+    static constexpr size_t DEFAULT_ASYNC_QUEUE_CAPACITY = 8192;
+    static constexpr std::chrono::microseconds DEFAULT_GROUP_COMMIT_WINDOW{2000};
+    static constexpr size_t ASYNC_MESSAGE_CAPACITY       = 512;
+
+    /**
+     * @struct RecordStamp
+     *
+     * @brief When a record was made and how many calls of its site
+     * a rate limit skipped since the previous record.
+     * A stamp made of CPU ticks has its time only once it is resolved
+     */
+    struct RecordStamp
+    {
+        RecordStamp(TimePoint time, uint32_t suppressed = 0) noexcept
+            : time(time), suppressed(suppressed) {}
+
+        RecordStamp(detail::CpuTicks ticks, uint32_t suppressed = 0) noexcept
+            : ticks(ticks.value), suppressed(suppressed) {}
+
+        TimePoint time{};
+        uint64_t  ticks = 0; ///< not converted yet if non-zero
+        uint32_t  suppressed = 0;
+
+        /**
+         * @brief Converts the ticks to wall-clock time
+         *
+         * @return RecordStamp with the time set
+         */
+        [[nodiscard]] RecordStamp Resolved() const noexcept
+        {
+            if (!ticks) return *this;
+
+            return {detail::GetTscClock().ToTime(ticks), suppressed};
+        }
+    };
+
+    virtual ~Logger()
+    {
+#ifndef DISABLE_LOGGING
+        reportRepeats();
+        DisableAsync();
+        DisableGroupCommit();
+        DisableFlightRecorder();
+#endif // ifndef DISABLE LOGGING
+    }
+
+    Logger() = default;
+
+    /**
+     * @brief Logger(FILE* logFile = stderr)
+     *
+     * @param [in] logFile
+     */
+    explicit Logger(FILE* logFile = stderr)
+    {
+#ifndef DISABLE_LOGGING
+        if (logFile)
+            setLogFile(std::make_shared<ConsoleSink>(logFile));
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Logger(const char* logFilePath)
+     * opens a file at the given path
+     *
+     * @param [in] logFilePath
+     */
+    explicit Logger(const char* logFilePath)
+    {
+#ifndef DISABLE_LOGGING
+        auto sink = std::make_shared<FileSink>(logFilePath);
+
+        if (sink->IsOpen())
+            setLogFile(std::move(sink));
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Logger(std::shared_ptr<Sink> sink)
+     * uses the sink as the log file, e.g. a RotatingFileSink
+     *
+     * @param [in] sink
+     */
+    explicit Logger(std::shared_ptr<Sink> sink)
+    {
+#ifndef DISABLE_LOGGING
+        setLogFile(std::move(sink));
+#endif // ifndef DISABLE LOGGING
+    }
+
+
+    /**
+     * @brief Disable logger
+     */
+    explicit Logger(std::nullptr_t) noexcept {}
+
+    /**
+     * @brief Sets log file
+     *
+     * @param [in] newLogFile
+     */
+    void SetLogFile(FILE* newLogFile)
+    {
+#ifndef DISABLE_LOGGING
+        setLogFile(newLogFile
+                   ? std::make_shared<ConsoleSink>(newLogFile, m_colorMode.load(std::memory_order_relaxed))
+                   : nullptr);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Opens a file and sets the logger log file
+     *
+     * @param [in] newLogFilePath
+     */
+    void SetLogFile(const char* newLogFilePath)
+    {
+#ifndef DISABLE_LOGGING
+        auto sink = std::make_shared<FileSink>(newLogFilePath);
+
+        setLogFile(sink->IsOpen() ? std::move(sink) : nullptr);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Sets the sink used as the log file
+     *
+     * @param [in] sink
+     */
+    void SetLogFile(std::shared_ptr<Sink> sink)
+    {
+#ifndef DISABLE_LOGGING
+        setLogFile(std::move(sink));
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Disable logger
+     */
+    void SetLogFile(std::nullptr_t)
+    {
+#ifndef DISABLE_LOGGING
+        setLogFile(nullptr);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Sets when records written to a stream are colored.
+     * By default they are if the stream is a terminal and NO_COLOR is not set.
+     * The stream is checked once, when it becomes the log file
+     *
+     * @param [in] mode
+     */
+    void SetColorMode(ColorMode mode)
+    {
+#ifndef DISABLE_LOGGING
+        m_colorMode.store(mode, std::memory_order_relaxed);
+
+        auto sinks = m_sinks.Read();
+
+        if (auto* console = sinks ? dynamic_cast<ConsoleSink*>(sinks->logFile.get()) : nullptr)
+            console->SetColorMode(mode);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Adds a sink, records are written to it
+     * in addition to the log file
+     *
+     * @param [in] sink
+     */
+    void AddSink(std::shared_ptr<Sink> sink)
+    {
+#ifndef DISABLE_LOGGING
+        if (!sink) return;
+
+        Flush();
+
+        // Tells the sink syncs are wanted before it gets any record
+        if (m_commit)
+            sink->Sync();
+
+        updateSinks(std::move(sink), [](SinkSet& sinks, std::shared_ptr<Sink> added)
+        {
+            sinks.sinks.push_back(std::move(added));
+        });
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Removes a sink added with AddSink
+     *
+     * @param [in] sink
+     */
+    void RemoveSink(const std::shared_ptr<Sink>& sink)
+    {
+#ifndef DISABLE_LOGGING
+        Flush();
+
+        updateSinks(nullptr, [&sink](SinkSet& sinks, std::shared_ptr<Sink>)
+        {
+            sinks.sinks.erase(std::remove(sinks.sinks.begin(), sinks.sinks.end(), sink), sinks.sinks.end());
+        });
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Sets the runtime minimum level.
+     * Records below it are skipped before their arguments are evaluated
+     *
+     * @param [in] minType
+     */
+    void SetLevel(LogType minType) noexcept
+    {
+        m_level.store(minType, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the runtime minimum level
+     *
+     * @return LogType
+     */
+    [[nodiscard]] LogType GetLevel() const noexcept
+    {
+        return m_level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Tells if records of this type pass the compile-time filter
+     * and either the runtime level or the flight recorder takes them
+     *
+     * @param [in] type
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsEnabled(LogType type) const noexcept
+    {
+        return type >= MLIB_LOG_LEVEL &&
+               (type >= m_level.load(std::memory_order_relaxed) ||
+                m_recording.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief Keeps the last records of every level, including those
+     * below the runtime level, in a preallocated in-memory ring.
+     * On SIGSEGV, SIGABRT, SIGBUS, SIGFPE or SIGILL the ring is written
+     * to dumpPath from the signal handler, then the previous handler runs.
+     * The handler runs on an alternate stack of the calling thread,
+     * a stack overflow of a thread without one can not be dumped.
+     * In async mode records still in the queue are not in the dump.
+     * Must not be called concurrently with Log
+     *
+     * @param [in] capacity ring size in bytes, the offsets of its records take a quarter more
+     * @param [in] dumpPath
+     *
+     * @return true the ring is dumped on fatal signals
+     * @return false records are kept but can not be dumped on this platform
+     */
+    bool EnableFlightRecorder(size_t capacity, const char* dumpPath)
+    {
+#ifndef DISABLE_LOGGING
+        DisableFlightRecorder();
+
+        std::unique_lock lock(m_mutex);
+
+        m_recorder = std::make_unique<detail::FlightRecorder>(capacity, dumpPath);
+        m_recording.store(true, std::memory_order_relaxed);
+
+        return detail::RegisterFlightRecorder(m_recorder.get());
+#else
+        return false;
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Stops recording. Must not be called concurrently with Log
+     */
+    void DisableFlightRecorder()
+    {
+#ifndef DISABLE_LOGGING
+        if (!m_recorder) return;
+
+        Flush();
+
+        std::unique_lock lock(m_mutex);
+
+        // Returns once no signal handler can be dumping it
+        detail::UnregisterFlightRecorder(m_recorder.get());
+        m_recording.store(false, std::memory_order_relaxed);
+        m_recorder.reset();
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Sets the output format. In binary format the file header
+     * is written immediately. Must not be called concurrently with Log
+     *
+     * @param [in] format
+     */
+    void SetOutputFormat(OutputFormat format)
+    {
+#ifndef DISABLE_LOGGING
+        Flush();
+
+        std::unique_lock lock(m_mutex);
+
+        if (format == m_outputFormat) return;
+
+        m_outputFormat = format;
+
+        if (format == OutputFormat::BINARY)
+        {
+            if (!m_sites)
+                m_sites = std::make_unique<detail::SiteRegistry>();
+
+            forEachSink([this](Sink& sink) { writeBinaryFileHeader(sink); });
+        }
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Collapses records repeated within the window.
+     * The first record of a call site and error code is written,
+     * the same site and error code within the window after it are only counted
+     * and reported as one "repeated N times in T ms" record before the next
+     * written record of the site, on Flush or when another site takes its slot.
+     * Zero disables collapsing. Must not be called concurrently with Log
+     *
+     * @param [in] window
+     */
+    void SetRepeatWindow(std::chrono::milliseconds window)
+    {
+#ifndef DISABLE_LOGGING
+        reportRepeats();
+
+        if (!m_repeats && window.count() > 0)
+            m_repeats = std::make_unique<detail::RepeatFilter>();
+
+        m_repeatWindow.store(std::chrono::duration_cast<std::chrono::nanoseconds>(window).count(),
+                             std::memory_order_relaxed);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Sets how many sub-second digits timestamps have.
+     * Milliseconds by default
+     *
+     * @param [in] precision
+     */
+    void SetTimestampPrecision(TimestampPrecision precision) noexcept
+    {
+        m_timestampPrecision.store(precision, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Starts a background thread that writes the records.
+     * Log calls then only format the message and push it to a queue.
+     * Messages longer than ASYNC_MESSAGE_CAPACITY are truncated.
+     * Must not be called concurrently with Log
+     *
+     * @param [in] queueCapacity number of records the queue holds
+     */
+    void EnableAsync(size_t queueCapacity = DEFAULT_ASYNC_QUEUE_CAPACITY)
+    {
+#ifndef DISABLE_LOGGING
+        if (m_async) return;
+
+        m_async = std::make_unique<AsyncState>(queueCapacity);
+        m_async->worker = std::thread(&Logger::asyncWorker, this);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Writes all queued records and stops the background thread.
+     * Must not be called concurrently with Log
+     */
+    void DisableAsync() noexcept
+    {
+#ifndef DISABLE_LOGGING
+        if (!m_async) return;
+
+        m_async->stop.store(true, std::memory_order_release);
+        m_async->worker.join();
+        m_async.reset();
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Makes records durable, a Log call returns once its record
+     * survives a power loss. A committer thread syncs the sinks, fdatasync
+     * for files, and one sync acknowledges every record written before it.
+     * After the first waiting record the committer gathers more for the window.
+     * Callers wait on a ticket, not on the logger mutex. In async mode a call
+     * also waits for the background thread to write its record.
+     * Must not be called concurrently with Log
+     *
+     * @param [in] window
+     */
+    void EnableGroupCommit(std::chrono::microseconds window = DEFAULT_GROUP_COMMIT_WINDOW)
+    {
+#ifndef DISABLE_LOGGING
+        DisableGroupCommit();
+
+        // The first sync tells sinks syncs are wanted, a rotating sink keeps rotated files for them
+        forEachSink([](Sink& sink) { sink.Sync(); });
+
+        m_commit = std::make_unique<CommitState>(window);
+        m_commit->committer = std::thread(&Logger::groupCommitter, this);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Syncs the records written so far and stops the committer thread.
+     * Must not be called concurrently with Log
+     */
+    void DisableGroupCommit() noexcept
+    {
+#ifndef DISABLE_LOGGING
+        if (!m_commit) return;
+
+        m_commit->stop.store(true, std::memory_order_release);
+        m_commit->requested.store(UINT64_MAX, std::memory_order_release);
+        m_commit->requested.notify_one();
+        m_commit->committer.join();
+        m_commit.reset();
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Sets what a Log call does when the async queue is full.
+     * Blocks by default. Dropped records are counted in the stats
+     * and reported as one "dropped N records" ERROR record
+     * by the background thread once it has room, or on Flush
+     *
+     * @param [in] policy
+     * @param [in] errorsBlock ERROR records wait for a slot whatever the policy is
+     */
+    void SetOverflowPolicy(OverflowPolicy policy, bool errorsBlock = false) noexcept
+    {
+        m_overflowPolicy.store(policy, std::memory_order_relaxed);
+        m_errorsBlock.store(errorsBlock, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Adds the id of the logging thread to every record as the "thread" field.
+     * The id is asked for once per thread
+     *
+     * @param [in] enabled
+     */
+    void SetThreadIdField(bool enabled) noexcept
+    {
+        m_threadIdField.store(enabled, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Is async mode enabled
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsAsync() const noexcept { return m_async != nullptr; }
+
+    /**
+     * @brief Sums the logger counters. Counters are sharded by thread,
+     * so Log never contends with this call or with other threads over them
+     *
+     * @return Stats
+     */
+    [[nodiscard]] Stats GetStats() const noexcept
+    {
+        return m_stats.Snapshot();
+    }
+
+    /**
+     * @brief Waits until every record logged so far is written
+     * and flushes the log file
+     */
+    void Flush() noexcept
+    {
+#ifndef DISABLE_LOGGING
+        reportRepeats();
+
+        if (m_async)
+        {
+            awaitWritten(m_async->queue.PushedCount());
+
+            Buffer buffer;
+            reportDropped(buffer);
+        }
+
+        std::unique_lock lock(m_mutex);
+
+        forEachSink([](Sink& sink) { sink.Flush(); });
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Used by the Log macros. Calls logCall(*this, position)
+     * only if the type is enabled, so the clock is not read
+     * and the arguments are not evaluated otherwise
+     *
+     * @tparam LogCall
+     *
+     * @param [in] type
+     * @param [in] position static call site of the macro
+     * @param [in] logCall
+     */
+    template<class LogCall>
+    void LogIfEnabled(LogType type, detail::SourcePosition position, LogCall&& logCall)
+    {
+#ifndef DISABLE_LOGGING
+        if (IsEnabled(type))
+            logCall(*this, position);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Used by the rate limited Log macros. Asks the call site limit
+     * only if the type is enabled, calls logCall(*this, position, suppressed)
+     * only if the limit lets the call through
+     *
+     * @tparam Limit
+     * @tparam LogCall
+     *
+     * @param [in] type
+     * @param [in] position static call site of the macro
+     * @param [in] limit bool(uint32_t& suppressed)
+     * @param [in] logCall
+     */
+    template<class Limit, class LogCall>
+    void LogLimited(LogType type, detail::SourcePosition position, Limit&& limit, LogCall&& logCall)
+    {
+#ifndef DISABLE_LOGGING
+        uint32_t suppressed = 0;
+
+        if (IsEnabled(type) && limit(suppressed))
+            logCall(*this, position, suppressed);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /**
+     * @brief Used by the Log macros for calls
+     * below the compile-time level. Does nothing
+     */
+    constexpr void Discard() const noexcept {}
+
+    /**
+     * @brief Function that actually logs stuff.
+     * Do not use it because source position and time are collected
+     * using macros
+     *
+     * @param [in] type
+     * @param [in] errorCode
+     * @param [in] position
+     * @param [in] stamp
+     */
+    void Log(LogType type, err::ErrorCode errorCode,
+             detail::SourcePosition position, RecordStamp stamp)
+    {
+        logRecord(type, errorCode, position, stamp, static_cast<const fmt::format_string<>*>(nullptr));
+    }
+
+    /**
+     * @brief Function that actually logs stuff.
+     * Do not use it because source position and time are collected
+     * using macros. The format string is checked at compile time,
+     * wrap runtime strings with fmt::runtime
+     *
+     * @tparam Args
+     *
+     * @param [in] type
+     * @param [in] errorCode
+     * @param [in] position
+     * @param [in] stamp
+     * @param [in] formatString
+     * @param [in] args
+     */
+    template<class... Args>
+    void Log(LogType type, err::ErrorCode errorCode,
+             detail::SourcePosition position, RecordStamp stamp,
+             fmt::format_string<Args...> formatString, Args&&... args)
+    {
+        logRecord(type, errorCode, position, stamp, &formatString, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Function that actually logs stuff.
+     * Do not use it because source position and time are collected
+     * using macros. Takes a format string wrapped with fmt::runtime.
+     * In binary format the message is formatted by the caller
+     * because the format string is not static
+     *
+     * @tparam Args
+     *
+     * @param [in] type
+     * @param [in] errorCode
+     * @param [in] position
+     * @param [in] stamp
+     * @param [in] formatString
+     * @param [in] args
+     */
+    template<class... Args>
+    void Log(LogType type, err::ErrorCode errorCode,
+             detail::SourcePosition position, RecordStamp stamp,
+             RuntimeFormat formatString, Args&&... args)
+    {
+        logRecord(type, errorCode, position, stamp, &formatString, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Function that actually logs stuff.
+     * Do not use it because source position and time are collected
+     * using macros. Takes a format string compiled with FMT_COMPILE,
+     * so it is never parsed at runtime
+     *
+     * @tparam CompiledFormat
+     * @tparam Args
+     *
+     * @param [in] type
+     * @param [in] errorCode
+     * @param [in] position
+     * @param [in] stamp
+     * @param [in] formatString
+     * @param [in] args
+     */
+    template<class CompiledFormat, class... Args,
+             std::enable_if_t<detail::IS_COMPILED_FORMAT<CompiledFormat>, int> = 0>
+    void Log(LogType type, err::ErrorCode errorCode,
+             detail::SourcePosition position, RecordStamp stamp,
+             const CompiledFormat& formatString, Args&&... args)
+    {
+        logRecord(type, errorCode, position, stamp, &formatString, std::forward<Args>(args)...);
+    }
+
+    using Buffer = fmt::memory_buffer;
+
+    /**
+     * @brief Appends the header of a text record, everything before the message.
+     * Used by the logger and by tools that render binary logs
+     *
+     * @param [in] buffer
+     * @param [in] colored add console color escapes
+     * @param [in] type
+     * @param [in] errorCode
+     * @param [in] timestamp
+     * @param [in] fileName
+     * @param [in] line
+     * @param [in] functionName
+     */
+    static void FormatTextHeader(Buffer& buffer, bool colored,
+                                 LogType type, err::ErrorCode errorCode, std::string_view timestamp,
+                                 std::string_view fileName, size_t line, std::string_view functionName)
+    {
+        formatTextStart(buffer, colored, type, errorCode, timestamp);
+        formatTextPosition(buffer, fileName, line, functionName);
+    }
+
+    /**
+     * @brief Appends the end of a text record, everything after the message
+     *
+     * @param [in] buffer
+     * @param [in] colored reset console color
+     * @param [in] suppressed calls of the site skipped by a rate limit
+     */
+    static void FormatTextFooter(Buffer& buffer, bool colored, uint32_t suppressed = 0)
+    {
+        if (suppressed)
+            fmt::format_to(std::back_inserter(buffer), "({} similar records suppressed)\n", suppressed);
+
+        buffer.push_back('\n');
+
+        if (colored)
+            appendString(buffer, GetConsoleColorSequence(detail::ConsoleColor::WHITE));
+    }
+
+    /**
+     * @class Batch
+     *
+     * @brief Records collected in one buffer and written together,
+     * with one lock acquisition and one write per sink.
+     *
+     * The Log macros work on a batch as on a Logger:
+     * @code
+     * Logger::Batch batch{logger};
+     *
+     * for (const Item& item : failed)
+     *     batch.LogError(err::ERROR_BAD_VALUE, "item {} failed", item.id);
+     * @endcode
+     * The records are written by Commit or when the batch is destroyed.
+     * Consecutive records of one call site share its formatted position.
+     * Records of a batch are not collapsed as repeats. In async mode
+     * the committing thread waits until the records queued so far are written,
+     * then writes the batch itself. A batch is used by one thread
+     * and must not outlive its logger
+     */
+    class Batch
+    {
+    public:
+        explicit Batch(Logger& logger) noexcept
+            : m_logger(logger) {}
+
+        ~Batch()
+        {
+            try
+            {
+                Commit();
+            }
+            catch (...)
+            {
+                // Nobody to report to, the records are lost
+            }
+        }
+
+        Batch(const Batch& other) = delete;
+        Batch& operator=(const Batch& other) = delete;
+
+        /**
+         * @brief Number of records waiting to be committed
+         *
+         * @return size_t
+         */
+        [[nodiscard]] size_t Size() const noexcept { return m_entries.size(); }
+
+        /**
+         * @brief Writes the collected records and empties the batch.
+         * With group commit it waits once for the whole batch
+         */
+        void Commit()
+        {
+#ifndef DISABLE_LOGGING
+            if (m_entries.empty()) return;
+
+            // Records this thread queued before go first
+            if (m_logger.m_async)
+                m_logger.awaitWritten(m_logger.m_async->queue.PushedCount());
+
+            {
+                std::unique_lock lock = m_logger.lockForWrite();
+
+                m_logger.writeBatch(*this);
+            }
+
+            if (m_logger.m_commit)
+                m_logger.awaitCommit();
+
+            Clear();
+#endif // ifndef DISABLE LOGGING
+        }
+
+        /**
+         * @brief Drops the collected records
+         */
+        void Clear() noexcept
+        {
+            m_colored.clear();
+            m_plain.clear();
+            m_args.clear();
+            m_entries.clear();
+            m_lastSite = nullptr;
+        }
+
+        /// @see Logger::LogIfEnabled
+        template<class LogCall>
+        void LogIfEnabled(LogType type, detail::SourcePosition position, LogCall&& logCall)
+        {
+#ifndef DISABLE_LOGGING
+            if (m_logger.IsEnabled(type))
+                logCall(*this, position);
+#endif // ifndef DISABLE LOGGING
+        }
+
+        /// @see Logger::LogLimited
+        template<class Limit, class LogCall>
+        void LogLimited(LogType type, detail::SourcePosition position, Limit&& limit, LogCall&& logCall)
+        {
+#ifndef DISABLE_LOGGING
+            uint32_t suppressed = 0;
+
+            if (m_logger.IsEnabled(type) && limit(suppressed))
+                logCall(*this, position, suppressed);
+#endif // ifndef DISABLE LOGGING
+        }
+
+        /// @see Logger::Discard
+        constexpr void Discard() const noexcept {}
+
+        /// @see Logger::Log
+        void Log(LogType type, err::ErrorCode errorCode,
+                 detail::SourcePosition position, RecordStamp stamp)
+        {
+            add(type, errorCode, position, stamp, static_cast<const fmt::format_string<>*>(nullptr));
+        }
+
+        /// @see Logger::Log
+        template<class... Args>
+        void Log(LogType type, err::ErrorCode errorCode,
+                 detail::SourcePosition position, RecordStamp stamp,
+                 fmt::format_string<Args...> formatString, Args&&... args)
+        {
+            add(type, errorCode, position, stamp, &formatString, std::forward<Args>(args)...);
+        }
+
+        /// @see Logger::Log
+        template<class... Args>
+        void Log(LogType type, err::ErrorCode errorCode,
+                 detail::SourcePosition position, RecordStamp stamp,
+                 RuntimeFormat formatString, Args&&... args)
+        {
+            add(type, errorCode, position, stamp, &formatString, std::forward<Args>(args)...);
+        }
+
+        /// @see Logger::Log
+        template<class CompiledFormat, class... Args,
+                 std::enable_if_t<detail::IS_COMPILED_FORMAT<CompiledFormat>, int> = 0>
+        void Log(LogType type, err::ErrorCode errorCode,
+                 detail::SourcePosition position, RecordStamp stamp,
+                 const CompiledFormat& formatString, Args&&... args)
+        {
+            add(type, errorCode, position, stamp, &formatString, std::forward<Args>(args)...);
+        }
+    private:
+        friend class Logger;
+
+        struct Entry
+        {
+            LogType        type = INFO;
+            err::ErrorCode errorCode = err::EVERYTHING_FINE;
+            RecordStamp    stamp{TimePoint{}};
+            uint32_t       siteId = detail::BINARY_INVALID_SITE;
+            uint8_t        argCount = 0;
+            size_t         coloredEnd = 0;
+            size_t         plainEnd = 0;
+            size_t         argsEnd = 0; ///< binary format only
+        };
+
+        Logger&            m_logger;
+        Buffer             m_colored{}; ///< records as the log file gets them
+        Buffer             m_plain{};   ///< text records without color escapes
+        Buffer             m_args{};    ///< encoded arguments of binary records
+        std::vector<Entry> m_entries{};
+
+        const detail::CallSite* m_lastSite = nullptr;
+        size_t                  m_lastPositionStart = 0;
+        size_t                  m_lastPositionEnd = 0;
+
+        template<class Format, class... Args>
+        void add(LogType type, err::ErrorCode errorCode,
+                 detail::SourcePosition position, RecordStamp stamp,
+                 const Format* formatString, Args&&... args)
+        {
+#ifndef DISABLE_LOGGING
+            Logger& logger = m_logger;
+
+            if (stamp.suppressed)
+                logger.m_stats.AddSuppressed(stamp.suppressed);
+
+            if (!logger.m_recorder && (!logger.isWritten(type) || !logger.hasSinks())) return;
+
+            stamp = stamp.Resolved();
+
+            Entry entry{type, errorCode, stamp};
+
+            if (logger.m_outputFormat == OutputFormat::BINARY)
+            {
+                size_t contextCount = logger.binaryContextCount();
+
+                entry.siteId   = logger.m_sites->Register(position.GetSite(),
+                                                          binarySiteFormat<Format, Args...>(formatString, contextCount));
+                entry.argCount = static_cast<uint8_t>(binaryArgCount<Format, Args...>(formatString) + contextCount);
+
+                size_t argsStart = m_args.size();
+                detail::BinaryBufferOut out{m_args};
+                encodeBinaryArgs(out, formatString, args...);
+                logger.encodeBinaryContext(out);
+
+                detail::AppendBinaryRecord(m_colored, entry.siteId, static_cast<uint8_t>(type), 0,
+                                           static_cast<int32_t>(errorCode), toNanoseconds(stamp.time),
+                                           entry.argCount, {m_args.data() + argsStart, m_args.size() - argsStart},
+                                           stamp.suppressed);
+            }
+            else if (logger.m_outputFormat == OutputFormat::JSON)
+            {
+                formatJsonStart(m_colored, type, errorCode, stamp.time);
+                appendPosition(position, [](Buffer& buffer, detail::SourcePosition site)
+                {
+                    formatJsonPosition(buffer, site);
+                });
+                formatJsonSuppressed(m_colored, stamp.suppressed);
+
+                if (formatString)
+                    formatJsonBody(m_colored, *formatString, std::forward<Args>(args)...);
+
+                logger.appendJsonFieldObject(m_colored, args...);
+                formatJsonFooter(m_colored);
+            }
+            else
+            {
+                size_t start = m_colored.size();
+                std::string_view timestamp = detail::GetThreadTimestampCache()
+                    .Format(stamp.time, logger.m_timestampPrecision.load(std::memory_order_relaxed));
+
+                formatTextStart(m_colored, true, type, errorCode, timestamp);
+                appendPosition(position, [](Buffer& buffer, detail::SourcePosition site)
+                {
+                    formatTextPosition(buffer, site.GetFileName(), site.GetLine(), site.GetFunctionName());
+                });
+
+                size_t bodyStart = m_colored.size();
+
+                if (formatString)
+                    formatTextBody(m_colored, *formatString, std::forward<Args>(args)...);
+
+                logger.appendTextContext(m_colored);
+
+                if (formatString || m_colored.size() != bodyStart)
+                    m_colored.push_back('\n');
+
+                formatFooter(m_colored, true, stamp.suppressed);
+
+                size_t prefix = getTypeColor(type).size();
+                size_t suffix = GetConsoleColorSequence(detail::ConsoleColor::WHITE).size();
+
+                m_plain.append(m_colored.data() + start + prefix, m_colored.data() + m_colored.size() - suffix);
+            }
+
+            entry.coloredEnd = m_colored.size();
+            entry.plainEnd   = m_plain.size();
+            entry.argsEnd    = m_args.size();
+
+            m_entries.push_back(entry);
+#endif // ifndef DISABLE LOGGING
+        }
+
+        /// Copies the position of the previous record if it has the same site
+        template<class Format>
+        void appendPosition(detail::SourcePosition position, Format&& format)
+        {
+            if (position.GetSite() == m_lastSite)
+            {
+                size_t size = m_lastPositionEnd - m_lastPositionStart;
+
+                m_colored.reserve(m_colored.size() + size);
+                m_colored.append(m_colored.data() + m_lastPositionStart, m_colored.data() + m_lastPositionEnd);
+                m_lastPositionStart = m_colored.size() - size;
+                m_lastPositionEnd   = m_colored.size();
+
+                return;
+            }
+
+            m_lastSite          = position.GetSite();
+            m_lastPositionStart = m_colored.size();
+            format(m_colored, position);
+            m_lastPositionEnd   = m_colored.size();
+        }
+    };
+
+private:
+
+    static constexpr fmt::format_string<uint32_t, int64_t> REPEATED_FORMAT{"repeated {} times in {} ms"};
+    static constexpr fmt::format_string<uint64_t> DROPPED_FORMAT{"dropped {} records, the async queue was full"};
+
+    struct AsyncRecord
+    {
+        LogType                type = INFO;
+        err::ErrorCode         errorCode = err::EVERYTHING_FINE;
+        detail::SourcePosition position{};
+        RecordStamp            stamp{TimePoint{}};
+        bool                   hasMessage = false;
+        OutputFormat           format = OutputFormat::TEXT;
+        uint32_t               siteId = detail::BINARY_INVALID_SITE;
+        uint8_t                flags = 0;
+        uint8_t                argCount = 0;
+        size_t                 messageSize = 0;
+        /// Formatted message or encoded arguments in binary format
+        char                   message[ASYNC_MESSAGE_CAPACITY];
+    };
+
+    struct AsyncState
+    {
+        explicit AsyncState(size_t queueCapacity)
+            : queue(queueCapacity) {}
+
+        detail::BoundedQueue<AsyncRecord> queue;
+        std::thread                       worker{};
+        std::atomic<bool>                 stop{false};
+        /// Records written or discarded, in push order
+        alignas(detail::CACHE_LINE_SIZE) std::atomic<size_t> written{0};
+        /// Threads blocked in awaitWritten, the worker wakes them only if there are any
+        alignas(detail::CACHE_LINE_SIZE) std::atomic<uint32_t> waiters{0};
+        /// Dropped and not reported yet
+        alignas(detail::CACHE_LINE_SIZE) std::atomic<uint64_t> dropped{0};
+    };
+
+    struct CommitState
+    {
+        explicit CommitState(std::chrono::microseconds window)
+            : window(window) {}
+
+        const std::chrono::microseconds window;
+        std::thread                     committer{};
+        std::atomic<bool>               stop{false};
+        /// Last ticket taken, a ticket is taken after the record is written
+        alignas(detail::CACHE_LINE_SIZE) std::atomic<uint64_t> tickets{0};
+        /// Highest ticket somebody waits for
+        alignas(detail::CACHE_LINE_SIZE) std::atomic<uint64_t> requested{0};
+        /// Every ticket up to it is durable
+        alignas(detail::CACHE_LINE_SIZE) std::atomic<uint64_t> synced{0};
+    };
+
+    /// Never changed once published, a change publishes a copy
+    struct SinkSet
+    {
+        std::shared_ptr<Sink>              logFile{};
+        std::vector<std::shared_ptr<Sink>> sinks{};
+        /// Every sink takes concurrent writes, records may be written without the mutex
+        bool                               concurrent = false;
+    };
+
+    detail::RcuPointer<SinkSet> m_sinks{};
+    std::mutex m_mutex{};
+    std::unique_ptr<AsyncState> m_async{};
+    std::unique_ptr<CommitState> m_commit{};
+    std::atomic<TimestampPrecision> m_timestampPrecision{TimestampPrecision::MILLISECONDS};
+    std::atomic<ColorMode> m_colorMode{ColorMode::AUTO};
+    std::atomic<OverflowPolicy> m_overflowPolicy{OverflowPolicy::BLOCK};
+    std::atomic<bool> m_errorsBlock{false};
+    std::atomic<bool> m_threadIdField{false};
+    std::atomic<LogType> m_level{DEBUG};
+    std::atomic<bool> m_recording{false};
+    std::unique_ptr<detail::FlightRecorder> m_recorder{};
+    std::atomic<int64_t> m_repeatWindow{0};
+    std::unique_ptr<detail::RepeatFilter> m_repeats{};
+    OutputFormat m_outputFormat = OutputFormat::TEXT;
+    std::unique_ptr<detail::SiteRegistry> m_sites{};
+    uint32_t m_fileGeneration = 0;
+    detail::LoggerStats m_stats{};
+
+    void setLogFile(std::shared_ptr<Sink> sink)
+    {
+        Flush();
+
+        updateSinks(std::move(sink), [](SinkSet& sinks, std::shared_ptr<Sink> added)
+        {
+            sinks.logFile = std::move(added);
+        });
+    }
+
+    /**
+     * Publishes a changed copy of the sink set. The mutex orders the binary
+     * header of the added sink before any record and serializes the changes,
+     * the replaced sinks are released after every reader of the old set is gone
+     */
+    template<class Modify>
+    void updateSinks(std::shared_ptr<Sink> added, Modify&& modify)
+    {
+        std::unique_ptr<SinkSet> retired{};
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            auto current = m_sinks.Read();
+            auto next = current ? std::make_unique<SinkSet>(*current) : std::make_unique<SinkSet>();
+
+            if (added && m_outputFormat == OutputFormat::BINARY)
+                writeBinaryFileHeader(*added);
+
+            modify(*next, std::move(added));
+            next->concurrent = isConcurrent(*next);
+            retired = m_sinks.Exchange(std::move(next));
+        }
+
+        m_sinks.Synchronize();
+    }
+
+    [[nodiscard]] bool hasSinks() noexcept
+    {
+        auto sinks = m_sinks.Read();
+
+        return sinks && (sinks->logFile || !sinks->sinks.empty());
+    }
+
+    static bool isConcurrent(const SinkSet& sinks) noexcept
+    {
+        bool any = false, all = true;
+
+        forEachSink(sinks, [&any, &all](Sink& sink)
+        {
+            any = true;
+            all = all && sink.IsConcurrent();
+        });
+
+        return any && all;
+    }
+
+    template<class Function>
+    static void forEachSink(const SinkSet& sinks, Function&& function)
+    {
+        if (sinks.logFile)
+            function(*sinks.logFile);
+
+        for (const std::shared_ptr<Sink>& sink : sinks.sinks)
+            function(*sink);
+    }
+
+    template<class Function>
+    void forEachSink(Function&& function)
+    {
+        auto sinks = m_sinks.Read();
+
+        if (sinks)
+            forEachSink(*sinks, function);
+    }
+
+    static void writeToSinks(const SinkSet& sinks, const SinkRecord& record)
+    {
+        forEachSink(sinks, [&record](Sink& sink)
+        {
+            if (sink.Accepts(record))
+                sink.Write(record);
+        });
+    }
+
+    void writeToSinks(const SinkRecord& record)
+    {
+        auto sinks = m_sinks.Read();
+
+        if (sinks)
+            writeToSinks(*sinks, record);
+    }
+
+    /// Writes a record and counts it in the stats
+    void writeCounted(const SinkRecord& record)
+    {
+        auto sinks = m_sinks.Read();
+
+        if (sinks)
+            writeCounted(*sinks, record);
+    }
+
+    /// The latency of only some writes is measured
+    void writeCounted(const SinkSet& sinks, const SinkRecord& record)
+    {
+        bool timed = detail::LoggerStats::SampleLatency();
+        auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        writeToSinks(sinks, record);
+
+        m_stats.AddWrite(record.type, record.plain.size());
+
+        if (timed)
+            m_stats.AddLatency(std::chrono::steady_clock::now() - start);
+    }
+
+    /// Writes a text or JSON record without the mutex if every sink takes concurrent writes
+    /// and the recorder is off. The set is read once, a sink added meanwhile is not written unlocked
+    bool writeConcurrently(const SinkRecord& record)
+    {
+        if (m_recorder) return false;
+
+        auto sinks = m_sinks.Read();
+
+        if (!sinks || !sinks->concurrent) return false;
+
+        if (isWritten(record.type))
+            writeCounted(*sinks, record);
+
+        return true;
+    }
+
+    /// Takes the mutex, the wait is timed only if it is contended
+    [[nodiscard]] std::unique_lock<std::mutex> lockForWrite()
+    {
+        std::unique_lock lock(m_mutex, std::try_to_lock);
+
+        if (!lock.owns_lock())
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            lock.lock();
+            m_stats.AddLockWait(std::chrono::steady_clock::now() - start);
+        }
+
+        return lock;
+    }
+
+    /// Pushes into the async queue, a full queue is handled by the overflow policy
+    template<class Fill>
+    void pushAsync(LogType type, Fill& fill)
+    {
+        if (m_async->queue.TryPush(fill)) return;
+
+        OverflowPolicy policy = type == ERROR && m_errorsBlock.load(std::memory_order_relaxed)
+                              ? OverflowPolicy::BLOCK
+                              : m_overflowPolicy.load(std::memory_order_relaxed);
+
+        if (policy == OverflowPolicy::DROP)
+        {
+            countDropped(1);
+            return;
+        }
+
+        if (policy == OverflowPolicy::OVERWRITE_OLDEST)
+        {
+            bool errorsBlock = m_errorsBlock.load(std::memory_order_relaxed);
+            Buffer buffer;
+
+            // A blocking ERROR is written here instead of being discarded,
+            // possibly after a newer record the worker has just taken
+            auto discard = [this, errorsBlock, &buffer](AsyncRecord& record) noexcept
+            {
+                if (errorsBlock && record.type == ERROR)
+                    writeAsync(buffer, record);
+                else
+                    countDropped(1);
+            };
+
+            // A discarded cell counts as written, Flush and the worker compare them with pushed ones
+            for (unsigned spins = 0; !m_async->queue.TryPush(fill); spins++)
+            {
+                if (m_async->queue.TryPop(discard))
+                    markWritten();
+                else
+                    backoff(spins);
+            }
+
+            return;
+        }
+
+        // The wait is timed only if there is one
+        auto start = std::chrono::steady_clock::now();
+
+        for (unsigned spins = 0; !m_async->queue.TryPush(fill); spins++)
+            backoff(spins);
+
+        m_stats.AddQueueWait(std::chrono::steady_clock::now() - start);
+    }
+
+    /// Counts a popped record, the increment and the waiters check are
+    /// sequentially consistent so either the waiter sees the new count or it is woken
+    size_t markWritten() noexcept
+    {
+        size_t written = m_async->written.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+        if (m_async->waiters.load(std::memory_order_seq_cst) != 0)
+            m_async->written.notify_all();
+
+        return written;
+    }
+
+    /// Blocks until the first `pushed` records are written
+    void awaitWritten(size_t pushed) noexcept
+    {
+        std::atomic<size_t>& written = m_async->written;
+
+        if (written.load(std::memory_order_acquire) >= pushed) return;
+
+        m_async->waiters.fetch_add(1, std::memory_order_seq_cst);
+
+        for (size_t current = written.load(std::memory_order_seq_cst); current < pushed;
+             current = written.load(std::memory_order_acquire))
+            written.wait(current, std::memory_order_acquire);
+
+        m_async->waiters.fetch_sub(1, std::memory_order_release);
+    }
+
+    void countDropped(uint64_t count) noexcept
+    {
+        m_stats.AddDropped(count);
+        m_async->dropped.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] bool isWritten(LogType type) const noexcept
+    {
+        return type >= m_level.load(std::memory_order_relaxed);
+    }
+
+    void writeText(LogType type, const Buffer& buffer)
+    {
+        SinkRecord record = makeTextRecord(type, buffer);
+
+        if (m_recorder)
+            m_recorder->Write(record.plain);
+
+        if (isWritten(type))
+            writeCounted(record);
+    }
+
+    void writeBinary(LogType type, uint32_t siteId, const Buffer& buffer)
+    {
+        if (!isWritten(type)) return;
+
+        writeBinarySite(siteId);
+        writeCounted(makeBinaryRecord(type, buffer));
+    }
+
+    /// The recorder keeps text, binary records are rendered like mlib-logcat does
+    void recordBinary(LogType type, uint8_t flags, err::ErrorCode errorCode, uint32_t siteId,
+                      RecordStamp stamp, uint8_t argCount, std::string_view args)
+    {
+        static constexpr std::string_view UNKNOWN = "<unknown>";
+
+        if (!m_recorder) return;
+
+        Buffer buffer;
+        std::string_view timestamp = detail::GetThreadTimestampCache()
+            .Format(stamp.time, m_timestampPrecision.load(std::memory_order_relaxed));
+
+        detail::SiteRegistry::Site unknownSite{};
+        const detail::SiteRegistry::Site& site = siteId == detail::BINARY_INVALID_SITE
+                                               ? unknownSite : m_sites->Get(siteId);
+
+        if (site.fileName)
+            FormatTextHeader(buffer, false, type, errorCode, timestamp, site.fileName, site.line, site.functionName);
+        else
+            FormatTextHeader(buffer, false, type, errorCode, timestamp, UNKNOWN, 0, UNKNOWN);
+
+        if (flags & detail::BINARY_RECORD_TRUNCATED)
+        {
+            appendString(buffer, "<arguments truncated>\n");
+        }
+        else if (site.format)
+        {
+            detail::RenderBinaryMessage(buffer, {site.format, site.formatSize}, args, argCount);
+            buffer.push_back('\n');
+        }
+
+        FormatTextFooter(buffer, false, stamp.suppressed);
+
+        m_recorder->Write({buffer.data(), buffer.size()});
+    }
+
+    void writeJson(LogType type, const Buffer& buffer)
+    {
+        std::string_view line{buffer.data(), buffer.size()};
+        SinkRecord record{type, false, line, line};
+
+        if (m_recorder)
+            m_recorder->Write(line);
+
+        if (isWritten(type))
+            writeCounted(record);
+    }
+
+    /// Called with the mutex held
+    void writeBatch(const Batch& batch)
+    {
+        using Entry = Batch::Entry;
+
+        const bool binary = m_outputFormat == OutputFormat::BINARY;
+        const bool text   = m_outputFormat == OutputFormat::TEXT;
+
+        auto colored = [&batch](const Entry& entry, size_t start)
+        {
+            return std::string_view{batch.m_colored.data() + start, entry.coloredEnd - start};
+        };
+        auto plain = [&batch, text, &colored](const Entry& entry, size_t coloredStart, size_t plainStart)
+        {
+            return text ? std::string_view{batch.m_plain.data() + plainStart, entry.plainEnd - plainStart}
+                        : colored(entry, coloredStart);
+        };
+
+        uint64_t records[detail::LOG_TYPE_COUNT] = {};
+        uint64_t bytes[detail::LOG_TYPE_COUNT] = {};
+        bool     allWritten = true;
+        LogType  minType = ERROR;
+
+        size_t coloredStart = 0, plainStart = 0, argsStart = 0;
+
+        for (const Entry& entry : batch.m_entries)
+        {
+            if (m_recorder)
+            {
+                if (binary)
+                    recordBinary(entry.type, 0, entry.errorCode, entry.siteId, entry.stamp, entry.argCount,
+                                 {batch.m_args.data() + argsStart, entry.argsEnd - argsStart});
+                else
+                    m_recorder->Write(plain(entry, coloredStart, plainStart));
+            }
+
+            if (isWritten(entry.type))
+            {
+                if (binary)
+                    writeBinarySite(entry.siteId);
+
+                records[entry.type]++;
+                bytes[entry.type] += plain(entry, coloredStart, plainStart).size();
+                minType = std::min(minType, entry.type);
+            }
+            else
+            {
+                allWritten = false;
+            }
+
+            coloredStart = entry.coloredEnd;
+            plainStart   = entry.plainEnd;
+            argsStart    = entry.argsEnd;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        std::string_view allColored{batch.m_colored.data(), batch.m_colored.size()};
+        std::string_view allPlain = text ? std::string_view{batch.m_plain.data(), batch.m_plain.size()} : allColored;
+        SinkRecord whole{minType, false, allColored, allPlain};
+
+        forEachSink([&](Sink& sink)
+        {
+            // Sinks that take every record get the batch in one write
+            if (allWritten && sink.Accepts(whole))
+            {
+                sink.Write(whole);
+                return;
+            }
+
+            size_t entryColoredStart = 0, entryPlainStart = 0;
+
+            for (const Entry& entry : batch.m_entries)
+            {
+                SinkRecord record{entry.type, false, colored(entry, entryColoredStart),
+                                  plain(entry, entryColoredStart, entryPlainStart)};
+
+                if (isWritten(entry.type) && sink.Accepts(record))
+                    sink.Write(record);
+
+                entryColoredStart = entry.coloredEnd;
+                entryPlainStart   = entry.plainEnd;
+            }
+        });
+
+        m_stats.AddBatchWrite(records, bytes, std::chrono::steady_clock::now() - start);
+    }
+
+    static SinkRecord makeTextRecord(LogType type, const Buffer& buffer) noexcept
+    {
+        std::string_view colored{buffer.data(), buffer.size()};
+        size_t prefix = getTypeColor(type).size();
+        size_t suffix = GetConsoleColorSequence(detail::ConsoleColor::WHITE).size();
+
+        return SinkRecord{type, false, colored, colored.substr(prefix, colored.size() - prefix - suffix)};
+    }
+
+    static SinkRecord makeBinaryRecord(LogType type, const Buffer& buffer) noexcept
+    {
+        std::string_view bytes{buffer.data(), buffer.size()};
+
+        return SinkRecord{type, false, bytes, bytes};
+    }
+
+    static void backoff(unsigned spins) noexcept
+    {
+        if (spins < 64)
+            return;
+        if (spins < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    template<class Format, class... Args>
+    void logRecord(LogType type, err::ErrorCode errorCode,
+                   detail::SourcePosition position, RecordStamp stamp,
+                   const Format* formatString, Args&&... args)
+    {
+#ifndef DISABLE_LOGGING
+        int64_t window = m_repeatWindow.load(std::memory_order_relaxed);
+
+        if (stamp.suppressed)
+            m_stats.AddSuppressed(stamp.suppressed);
+
+        if (window > 0)
+        {
+            detail::RepeatFilter::Repeats repeats{};
+
+            stamp = stamp.Resolved();
+
+            if (!m_repeats->Check(type, errorCode, position, toNanoseconds(stamp.time), window, repeats))
+            {
+                m_stats.AddSuppressed(1);
+                return;
+            }
+
+            if (repeats.count)
+                reportRepeated(repeats);
+        }
+
+        writeRecord(type, errorCode, position, stamp, formatString, std::forward<Args>(args)...);
+
+        if (m_commit && isWritten(type))
+            awaitCommit();
+#endif // ifndef DISABLE LOGGING
+    }
+
+    /// Waits until the records this thread has written are synced
+    void awaitCommit() noexcept
+    {
+        if (m_async)
+            awaitWritten(m_async->queue.PushedCount());
+
+        CommitState& commit = *m_commit;
+        uint64_t ticket = commit.tickets.fetch_add(1, std::memory_order_acq_rel) + 1;
+        uint64_t requested = commit.requested.load(std::memory_order_relaxed);
+
+        while (requested < ticket &&
+               !commit.requested.compare_exchange_weak(requested, ticket, std::memory_order_release,
+                                                       std::memory_order_relaxed)) {}
+
+        if (requested < ticket)
+            commit.requested.notify_one();
+
+        for (uint64_t synced = commit.synced.load(std::memory_order_acquire); synced < ticket;
+             synced = commit.synced.load(std::memory_order_acquire))
+            commit.synced.wait(synced, std::memory_order_acquire);
+    }
+
+    /// A sync covers every ticket taken before it starts
+    void groupCommitter() noexcept
+    {
+        CommitState& commit = *m_commit;
+        uint64_t synced = 0;
+
+        for (;;)
+        {
+            uint64_t requested = commit.requested.load(std::memory_order_acquire);
+
+            if (requested <= synced)
+            {
+                commit.requested.wait(requested, std::memory_order_acquire);
+                continue;
+            }
+
+            bool stop = commit.stop.load(std::memory_order_acquire);
+
+            if (!stop)
+                std::this_thread::sleep_for(commit.window);
+
+            uint64_t target = commit.tickets.load(std::memory_order_acquire);
+
+            forEachSink([](Sink& sink) { sink.Sync(); });
+
+            synced = target;
+            commit.synced.store(target, std::memory_order_release);
+            commit.synced.notify_all();
+
+            if (stop) break;
+        }
+    }
+
+    void reportRepeated(const detail::RepeatFilter::Repeats& repeats)
+    {
+        TimePoint time{std::chrono::duration_cast<TimePoint::duration>(std::chrono::nanoseconds(repeats.lastTime))};
+        int64_t milliseconds = (repeats.lastTime - repeats.windowStart) / 1'000'000;
+
+        writeRecord(repeats.type, repeats.errorCode, repeats.position, time,
+                    &REPEATED_FORMAT, uint32_t{repeats.count}, int64_t{milliseconds});
+    }
+
+    void reportRepeats() noexcept
+    {
+        if (!m_repeats) return;
+
+        try
+        {
+            m_repeats->Drain([this](const detail::RepeatFilter::Repeats& repeats) { reportRepeated(repeats); });
+        }
+        catch (...)
+        {
+            // Nobody to report to, the counts are lost
+        }
+    }
+
+    template<class Format, class... Args>
+    void writeRecord(LogType type, err::ErrorCode errorCode,
+                     detail::SourcePosition position, RecordStamp stamp,
+                     const Format* formatString, Args&&... args)
+    {
+#ifndef DISABLE_LOGGING
+        if (!hasSinks() && !m_recorder) return;
+
+        if (m_outputFormat == OutputFormat::BINARY)
+        {
+            logBinary(type, errorCode, position, stamp, formatString, std::forward<Args>(args)...);
+            return;
+        }
+
+        if (m_async)
+        {
+            OutputFormat format = m_outputFormat;
+
+            auto fill = [&](AsyncRecord& record) noexcept
+            {
+                record.type      = type;
+                record.errorCode = errorCode;
+                record.position  = position;
+                record.stamp     = stamp;
+                record.format    = format;
+
+                record.messageSize = formatMessage(format, record.message, formatString, std::forward<Args>(args)...);
+                record.hasMessage  = formatString != nullptr || record.messageSize != 0;
+            };
+
+            pushAsync(type, fill);
+            return;
+        }
+
+        stamp = stamp.Resolved();
+
+        Buffer buffer;
+
+        if (m_outputFormat == OutputFormat::JSON)
+        {
+            formatJsonHeader(buffer, type, errorCode, position, stamp);
+
+            if (formatString)
+                formatJsonBody(buffer, *formatString, std::forward<Args>(args)...);
+
+            appendJsonFieldObject(buffer, args...);
+            formatJsonFooter(buffer);
+
+            std::string_view line{buffer.data(), buffer.size()};
+
+            if (writeConcurrently(SinkRecord{type, false, line, line})) return;
+
+            std::unique_lock lock = lockForWrite();
+
+            writeJson(type, buffer);
+            return;
+        }
+
+        formatHeader(buffer, true, type, errorCode, position, stamp.time);
+
+        size_t bodyStart = buffer.size();
+
+        if (formatString)
+            formatTextBody(buffer, *formatString, std::forward<Args>(args)...);
+
+        appendTextContext(buffer);
+
+        if (formatString || buffer.size() != bodyStart)
+            buffer.push_back('\n');
+
+        formatFooter(buffer, true, stamp.suppressed);
+
+        if (writeConcurrently(makeTextRecord(type, buffer))) return;
+
+        std::unique_lock lock = lockForWrite();
+
+        writeText(type, buffer);
+#endif // ifndef DISABLE LOGGING
+    }
+
+    template<class Format, class... Args>
+    void logBinary(LogType type, err::ErrorCode errorCode,
+                   detail::SourcePosition position, RecordStamp stamp,
+                   const Format* formatString, Args&&... args)
+    {
+        size_t contextCount = binaryContextCount();
+        uint32_t siteId = m_sites->Register(position.GetSite(), binarySiteFormat<Format, Args...>(formatString, contextCount));
+        uint8_t argCount = static_cast<uint8_t>(binaryArgCount<Format, Args...>(formatString) + contextCount);
+
+        auto encode = [&](auto& out)
+        {
+            encodeBinaryArgs(out, formatString, args...);
+            encodeBinaryContext(out);
+        };
+
+        if (m_async)
+        {
+            auto fill = [&](AsyncRecord& record) noexcept
+            {
+                record.type      = type;
+                record.errorCode = errorCode;
+                record.stamp     = stamp;
+                record.format    = OutputFormat::BINARY;
+                record.siteId    = siteId;
+
+                detail::BinaryFixedOut out{record.message, ASYNC_MESSAGE_CAPACITY};
+                bool ok = true;
+
+                try
+                {
+                    encode(out);
+                }
+                catch (...)
+                {
+                    ok = false;
+                }
+
+                ok = ok && !out.Overflowed();
+
+                record.flags       = ok ? 0 : detail::BINARY_RECORD_TRUNCATED;
+                record.argCount    = ok ? argCount : 0;
+                record.messageSize = ok ? out.Size() : 0;
+            };
+
+            pushAsync(type, fill);
+            return;
+        }
+
+        stamp = stamp.Resolved();
+
+        Buffer encodedArgs;
+        detail::BinaryBufferOut out{encodedArgs};
+        encode(out);
+
+        Buffer buffer;
+        detail::AppendBinaryRecord(buffer, siteId, static_cast<uint8_t>(type), 0,
+                                   static_cast<int32_t>(errorCode), toNanoseconds(stamp.time),
+                                   argCount, {encodedArgs.data(), encodedArgs.size()}, stamp.suppressed);
+
+        std::unique_lock lock = lockForWrite();
+
+        writeBinary(type, siteId, buffer);
+        recordBinary(type, 0, errorCode, siteId, stamp, argCount, {encodedArgs.data(), encodedArgs.size()});
+    }
+
+    /// Runtime format strings, and messages with an argument the binary format
+    /// does not store raw, are formatted by the caller. The format specs apply
+    /// to the real type then, as in text mode
+    template<class Format, class... Args>
+    static constexpr bool IS_PREFORMATTED = std::is_same_v<Format, RuntimeFormat>
+                                         || !(true && ... && detail::IS_RAW_BINARY_ARG<Args>);
+
+    /// Preformatted messages are formatted by the caller, their site only has "{}".
+    /// A record without a message still needs an empty one to show its context
+    template<class Format, class... Args>
+    static std::string_view binarySiteFormat(const Format* formatString, size_t contextCount) noexcept
+    {
+        if (!formatString)
+            return contextCount ? std::string_view{""} : std::string_view{};
+
+        if constexpr (IS_PREFORMATTED<Format, Args...>)
+            return "{}";
+        else
+            return toStringView(fmt::string_view(*formatString));
+    }
+
+    template<class Format, class... Args>
+    static uint8_t binaryArgCount(const Format* formatString) noexcept
+    {
+        static_assert(sizeof...(Args) <= UINT8_MAX - detail::CONTEXT_CAPACITY - 1,
+                      "Too many arguments for binary format");
+
+        static constexpr uint8_t FIELD_COUNT = (0 + ... + detail::IS_FIELD<Args>);
+
+        if (!formatString)
+            return 0;
+
+        if constexpr (IS_PREFORMATTED<Format, Args...>)
+            return 1 + FIELD_COUNT;
+        else
+            return static_cast<uint8_t>(sizeof...(Args));
+    }
+
+    template<class Out, class Format, class... Args>
+    static void encodeBinaryArgs(Out& out, const Format* formatString, const Args&... args)
+    {
+        if (!formatString) return;
+
+        if constexpr (IS_PREFORMATTED<Format, Args...>)
+        {
+            if constexpr (std::is_same_v<Format, RuntimeFormat>)
+                detail::EncodeBinaryFormatted(out, *formatString, args...);
+            else
+                detail::EncodeBinaryFormatted(out, fmt::runtime(fmt::string_view(*formatString)), args...);
+
+            // Fields still go raw, the message is formatted without them
+            [[maybe_unused]] auto encodeField = [&out](const auto& arg)
+            {
+                if constexpr (detail::IS_FIELD<decltype(arg)>)
+                    detail::EncodeBinaryArg(out, arg);
+            };
+
+            (encodeField(args), ...);
+        }
+        else
+        {
+            (detail::EncodeBinaryArg(out, args), ...);
+        }
+    }
+
+    /// Context pairs and the thread id go after the arguments as named ones
+    [[nodiscard]] size_t binaryContextCount() const noexcept
+    {
+        return detail::GetThreadContext().Size() + m_threadIdField.load(std::memory_order_relaxed);
+    }
+
+    template<class Out>
+    void encodeBinaryContext(Out& out) const
     {
-        INFO,
-        DEBUG,
-        ERROR,
-    };
+        detail::EncodeBinaryContext(out, detail::GetThreadContext(), m_threadIdField.load(std::memory_order_relaxed));
+    }
 
-    virtual ~Logger() = default;
+    template<class Out>
+    void appendTextContext(Out& buffer) const
+    {
+        detail::AppendTextContext(buffer, detail::GetThreadContext(), m_threadIdField.load(std::memory_order_relaxed));
+    }
 
-    Logger() = default;
+    /// Fields and context go into one "fields" object, so their names never collide
+    /// with the keys of the record. The object is left out if it would be empty
+    template<class Out, class... Args>
+    void appendJsonFieldObject(Out& buffer, const Args&... args) const
+    {
+        static constexpr std::string_view KEY = ",\"fields\":";
 
-    /**
-     * @brief Logger(FILE* logFile = stderr)
-     *
-     * @param [in] logFile
-     */
-    explicit Logger(FILE* logFile = stderr) noexcept
-        : m_logFile(logFile)
+        size_t start = buffer.size();
+        appendString(buffer, KEY);
+
+        detail::AppendJsonFields(buffer, args...);
+        detail::AppendJsonContext(buffer, detail::GetThreadContext(), m_threadIdField.load(std::memory_order_relaxed));
+
+        if (buffer.size() == start + KEY.size())
+        {
+            buffer.resize(start);
+            return;
+        }
+
+        // Every member starts with a comma, the first one opens the object instead
+        buffer[start + KEY.size()] = '{';
+        buffer.push_back('}');
+    }
+
+    /// Sites are written again after the header, every sink has to know them
+    void writeBinaryFileHeader(Sink& sink)
     {
-#ifndef DISABLE_LOGGING
-        std::setbuf(m_logFile, nullptr);
-#endif // ifndef DISABLE LOGGING
+        m_fileGeneration++;
+
+        Buffer buffer;
+        detail::AppendBinaryFileHeader(buffer);
+
+        std::string_view bytes{buffer.data(), buffer.size()};
+        sink.Write(SinkRecord{INFO, true, bytes, bytes});
     }
 
-    /**
-     * @brief Logger(const char* logFilePath)
-     * opens a file at the given path
-     *
-     * @param [in] logFilePath
-     */
-    explicit Logger(const char* logFilePath) noexcept
-        : Logger(std::fopen(logFilePath, "w")) {}
+    void writeBinarySite(uint32_t siteId)
+    {
+        if (siteId == detail::BINARY_INVALID_SITE) return;
 
+        detail::SiteRegistry::Site& site = m_sites->Get(siteId);
 
-    /**
-     * @brief Disable logger
-     */
-    explicit Logger(std::nullptr_t) noexcept {}
+        if (site.emittedGeneration == m_fileGeneration) return;
 
-    /**
-     * @brief Sets log file
-     *
-     * @param [in] newLogFile
-     */
-    void SetLogFile(FILE* newLogFile) noexcept
+        Buffer buffer;
+        detail::AppendBinarySite(buffer, siteId, site.fileName, site.functionName, site.line,
+                                 {site.format, site.formatSize});
+
+        std::string_view bytes{buffer.data(), buffer.size()};
+        writeToSinks(SinkRecord{INFO, true, bytes, bytes});
+        site.emittedGeneration = m_fileGeneration;
+    }
+
+    static std::string_view toStringView(fmt::string_view string) noexcept
     {
-#ifndef DISABLE_LOGGING
-        m_logFile.Flush();
+        return {string.data(), string.size()};
+    }
+
+    static int64_t toNanoseconds(TimePoint time) noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
 
-        m_logFile.m_file = newLogFile;
+    /// Formats the message, if there is one, and the context of the calling thread
+    template<class Format, class... Args>
+    size_t formatMessage(OutputFormat format, char (&buffer)[ASYNC_MESSAGE_CAPACITY],
+                         const Format* formatString, Args&&... args) noexcept
+    {
+        static constexpr std::string_view TRUNCATED      = "...";
+        static constexpr std::string_view JSON_TRUNCATED = ",\"message\":\"<message truncated>\"";
+
+        fmt::basic_memory_buffer<char, ASYNC_MESSAGE_CAPACITY> message;
+
+        try
+        {
+            try
+            {
+                if (format == OutputFormat::JSON)
+                {
+                    if (formatString)
+                        formatJsonBody(message, *formatString, std::forward<Args>(args)...);
 
-        if (newLogFile)
+                    appendJsonFieldObject(message, args...);
+                }
+                else
+                {
+                    if (formatString)
+                        formatTextBody(message, *formatString, std::forward<Args>(args)...);
+
+                    appendTextContext(message);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                message.clear();
+
+                if (format == OutputFormat::JSON)
+                {
+                    appendString(message, ",\"message\":");
+                    detail::AppendJsonString(message, fmt::format("<format error: {}>", e.what()));
+                    appendJsonFieldObject(message);
+                }
+                else
+                {
+                    fmt::format_to(std::back_inserter(message), "<format error: {}>", e.what());
+                    appendTextContext(message);
+                }
+            }
+        }
+        catch (...)
         {
-            std::setbuf(newLogFile, nullptr);
+            message.clear();
         }
-#endif // ifndef DISABLE LOGGING
+
+        if (message.size() <= ASYNC_MESSAGE_CAPACITY)
+        {
+            std::copy(message.begin(), message.end(), buffer);
+            return message.size();
+        }
+
+        if (format == OutputFormat::JSON)
+        {
+            std::copy(JSON_TRUNCATED.begin(), JSON_TRUNCATED.end(), buffer);
+            return JSON_TRUNCATED.size();
+        }
+
+        std::copy(message.begin(), message.begin() + ASYNC_MESSAGE_CAPACITY, buffer);
+        std::copy(TRUNCATED.begin(), TRUNCATED.end(), buffer + ASYNC_MESSAGE_CAPACITY - TRUNCATED.size());
+        return ASYNC_MESSAGE_CAPACITY;
     }
 
-    /**
-     * @brief Opens a file and sets the logger log file
-     *
-     * @param [in] newLogFilePath
-     */
-    void SetLogFile(const char* newLogFilePath) noexcept
+    template<class Out, class Format, class... Args>
+    static void formatTextBody(Out& buffer, const Format& formatString, Args&&... args)
     {
-#ifndef DISABLE_LOGGING
-        SetLogFile(fopen(newLogFilePath, "w"));
-#endif // ifndef DISABLE LOGGING
+        fmt::format_to(std::back_inserter(buffer), formatString, std::forward<Args>(args)...);
+        detail::AppendTextFields(buffer, args...);
     }
 
-    /**
-     * @brief Disable logger
-     */
-    void SetLogFile(std::nullptr_t) noexcept
+    /// The fields are appended by appendJsonFieldObject
+    template<class Out, class Format, class... Args>
+    static void formatJsonBody(Out& buffer, const Format& formatString, Args&&... args)
     {
-#ifndef DISABLE_LOGGING
-        SetLogFile(static_cast<FILE*>(nullptr));
-#endif // ifndef DISABLE LOGGING
+        appendString(buffer, ",\"message\":\"");
+        fmt::format_to(detail::JsonEscapeIterator<Out>{buffer}, formatString, std::forward<Args>(args)...);
+        buffer.push_back('"');
     }
 
-    /**
-     * @brief Function that actually logs stuff.
-     * Do not use it because source position and time are collected
-     * using macros
-     *
-     * @tparam Args
-     *
-     * @param [in] type
-     * @param [in] errorCode
-     * @param [in] position
-     * @param [in] time
-     * @param [in] formatString
-     * @param [in] args
-     */
-    template<class... Args>
-    void Log(LogType type, err::ErrorCode errorCode,
-             detail::SourcePosition position, TimePoint time,
-             const char* formatString = nullptr, Args&&... args)
+    void formatJsonHeader(Buffer& buffer, LogType type, err::ErrorCode errorCode,
+                          detail::SourcePosition position, RecordStamp stamp)
     {
-#ifndef DISABLE_LOGGING
-        if (!m_logFile) return;
+        formatJsonStart(buffer, type, errorCode, stamp.time);
+        formatJsonPosition(buffer, position);
+        formatJsonSuppressed(buffer, stamp.suppressed);
+    }
 
-        std::unique_lock lock(m_mutex);
+    static void formatJsonStart(Buffer& buffer, LogType type, err::ErrorCode errorCode, TimePoint time)
+    {
+        fmt::format_to(std::back_inserter(buffer), "{{\"time\":{},\"type\":\"{}\",\"error\":\"{}\"",
+                       toNanoseconds(time), getTypeName(type), err::GetErrorName(errorCode));
+    }
+
+    static void formatJsonPosition(Buffer& buffer, detail::SourcePosition position)
+    {
+        appendString(buffer, ",\"file\":");
+        detail::AppendJsonString(buffer, position.GetFileName());
+        fmt::format_to(std::back_inserter(buffer), ",\"line\":{},\"function\":", position.GetLine());
+        detail::AppendJsonString(buffer, position.GetFunctionName());
+    }
 
-        printType(type);
+    static void formatJsonSuppressed(Buffer& buffer, uint32_t suppressed)
+    {
+        if (suppressed)
+            fmt::format_to(std::back_inserter(buffer), ",\"suppressed\":{}", suppressed);
+    }
 
-        std::time_t t = std::chrono::system_clock::to_time_t(time);
-        std::tm tm = *std::localtime(&t);
+    static void formatJsonFooter(Buffer& buffer)
+    {
+        appendString(buffer, "}\n");
+    }
 
-        fmt::print(m_logFile, " {}:", fmt::streamed(std::put_time(&tm, "%d/%m/%Y %T %Z")));
+    /// Writes a record taken from the async queue
+    void writeAsync(Buffer& buffer, const AsyncRecord& record) noexcept
+    {
+        buffer.clear();
 
-        if (errorCode)
+        RecordStamp stamp = record.stamp.Resolved();
+
+        std::unique_lock lock = lockForWrite();
+
+        try
+        {
+            if (record.format == OutputFormat::BINARY)
+            {
+                detail::AppendBinaryRecord(buffer, record.siteId, static_cast<uint8_t>(record.type),
+                                           record.flags, static_cast<int32_t>(record.errorCode),
+                                           toNanoseconds(stamp.time), record.argCount,
+                                           {record.message, record.messageSize}, stamp.suppressed);
+
+                writeBinary(record.type, record.siteId, buffer);
+                recordBinary(record.type, record.flags, record.errorCode, record.siteId,
+                             stamp, record.argCount,
+                             {record.message, record.messageSize});
+                return;
+            }
+
+            if (record.format == OutputFormat::JSON)
+            {
+                formatJsonHeader(buffer, record.type, record.errorCode, record.position, stamp);
+                buffer.append(record.message, record.message + record.messageSize);
+                formatJsonFooter(buffer);
+
+                writeJson(record.type, buffer);
+                return;
+            }
+
+            formatHeader(buffer, true, record.type, record.errorCode, record.position, stamp.time);
+
+            if (record.hasMessage)
+            {
+                buffer.append(record.message, record.message + record.messageSize);
+                buffer.push_back('\n');
+            }
+
+            formatFooter(buffer, true, stamp.suppressed);
+
+            writeText(record.type, buffer);
+        }
+        catch (...)
         {
-            fmt::print(m_logFile, " {}:{}", err::GetErrorName(errorCode), static_cast<int>(errorCode));
+            // Nobody to report to, the record is lost
+            m_stats.AddDropped(1);
         }
+    }
 
-        fmt::println(m_logFile,
-                     " {}:{} in {}",
-                     position.GetFileName(),
-                     position.GetLine(),
-                     position.GetFunctionName()
-        );
+    /// Writes one record with the number of records the overflow policy dropped since the last one
+    void reportDropped(Buffer& buffer) noexcept
+    {
+        if (m_async->dropped.load(std::memory_order_relaxed) == 0) return;
 
-        if (formatString)
+        uint64_t count = m_async->dropped.exchange(0, std::memory_order_relaxed);
+        if (!count) return;
+
+        AsyncRecord record{};
+
+        record.type       = ERROR;
+        record.errorCode  = err::EVERYTHING_FINE;
+        record.position   = CURRENT_SOURCE_POSITION();
+        record.stamp      = RecordStamp{std::chrono::system_clock::now()};
+        record.format     = m_outputFormat;
+        record.hasMessage = true;
+
+        if (record.format == OutputFormat::BINARY)
+        {
+            try
+            {
+                record.siteId = m_sites->Register(record.position.GetSite(),
+                                                  toStringView(fmt::string_view(DROPPED_FORMAT)));
+            }
+            catch (...)
+            {
+                // Nobody to report to, the count is lost
+                return;
+            }
+
+            detail::BinaryFixedOut out{record.message, ASYNC_MESSAGE_CAPACITY};
+            detail::EncodeBinaryArg(out, count);
+
+            record.argCount    = 1;
+            record.messageSize = out.Size();
+        }
+        else
         {
-            fmt::println(m_logFile, fmt::runtime(formatString), std::forward<Args>(args)...);
+            record.messageSize = formatMessage(record.format, record.message, &DROPPED_FORMAT, uint64_t{count});
         }
 
-        fmt::print(m_logFile, "\n");
+        writeAsync(buffer, record);
+    }
 
-        SetConsoleColor(m_logFile, detail::ConsoleColor::WHITE);
-#endif
+    void asyncWorker() noexcept
+    {
+        Buffer buffer;
+
+        auto write = [this, &buffer](AsyncRecord& record)
+        {
+            writeAsync(buffer, record);
+            reportDropped(buffer);
+        };
+
+        // The depth is sampled, reading the producer position on every pop would slow them down
+        static constexpr size_t DEPTH_SAMPLE_PERIOD = 32;
+
+        for (unsigned spins = 0;;)
+        {
+            if (m_async->queue.TryPop(write))
+            {
+                size_t written = markWritten();
+
+                if (written % DEPTH_SAMPLE_PERIOD == 0)
+                    m_stats.UpdateQueueDepth(m_async->queue.Size() + 1);
+
+                spins = 0;
+                continue;
+            }
+
+            if (m_async->stop.load(std::memory_order_acquire) &&
+                m_async->written.load(std::memory_order_relaxed) == m_async->queue.PushedCount())
+                break;
+
+            backoff(spins++);
+        }
     }
 
-private:
-    detail::File m_logFile{nullptr};
-    std::mutex m_mutex{};
+    void formatHeader(Buffer& buffer, bool colored,
+                      LogType type, err::ErrorCode errorCode,
+                      detail::SourcePosition position, TimePoint time)
+    {
+        std::string_view timestamp = detail::GetThreadTimestampCache()
+            .Format(time, m_timestampPrecision.load(std::memory_order_relaxed));
+
+        FormatTextHeader(buffer, colored, type, errorCode, timestamp,
+                         position.GetFileName(), position.GetLine(), position.GetFunctionName());
+    }
 
-    void printType(LogType type) noexcept
+    static void formatFooter(Buffer& buffer, bool colored, uint32_t suppressed)
     {
-#ifndef DISABLE_LOGGING
+        FormatTextFooter(buffer, colored, suppressed);
+    }
+
+    /// The header up to the source position
+    static void formatTextStart(Buffer& buffer, bool colored,
+                                LogType type, err::ErrorCode errorCode, std::string_view timestamp)
+    {
+        formatType(buffer, colored, type);
+
+        buffer.push_back(' ');
+        appendString(buffer, timestamp);
+        buffer.push_back(':');
+
+        if (errorCode)
+        {
+            fmt::format_to(std::back_inserter(buffer), " {}:{}",
+                           err::GetErrorName(errorCode), static_cast<int>(errorCode));
+        }
+    }
+
+    static void formatTextPosition(Buffer& buffer, std::string_view fileName,
+                                   size_t line, std::string_view functionName)
+    {
+        fmt::format_to(std::back_inserter(buffer), " {}:{} in {}\n", fileName, line, functionName);
+    }
+
+    static void formatType(Buffer& buffer, bool colored, LogType type)
+    {
+        if (colored)
+            appendString(buffer, getTypeColor(type));
+
         switch (type)
         {
             case INFO:
-                SetConsoleColor(m_logFile, detail::ConsoleColor::CYAN);
-                fmt::print(m_logFile, "[INFO]");
+                appendString(buffer, "[INFO]");
                 break;
             case DEBUG:
-                SetConsoleColor(m_logFile, detail::ConsoleColor::YELLOW);
-                fmt::print(m_logFile, "[DEBUG]");
+                appendString(buffer, "[DEBUG]");
                 break;
             case ERROR:
-                SetConsoleColor(m_logFile, detail::ConsoleColor::RED);
-                fmt::print(m_logFile, "[ERROR]");
+                appendString(buffer, "[ERROR]");
                 break;
             default:
-                fmt::print(m_logFile, "[UNKNOWN LOG TYPE]");
+                appendString(buffer, "[UNKNOWN LOG TYPE]");
                 break;
         }
-#endif // ifndef DISABLE LOGGING
     }
+
+    static std::string_view getTypeName(LogType type) noexcept
+    {
+        switch (type)
+        {
+            case INFO:
+                return "INFO";
+            case DEBUG:
+                return "DEBUG";
+            case ERROR:
+                return "ERROR";
+            default:
+                return "UNKNOWN";
+        }
+    }
+
+    static std::string_view getTypeColor(LogType type) noexcept
+    {
+        switch (type)
+        {
+            case INFO:
+                return GetConsoleColorSequence(detail::ConsoleColor::CYAN);
+            case DEBUG:
+                return GetConsoleColorSequence(detail::ConsoleColor::YELLOW);
+            case ERROR:
+                return GetConsoleColorSequence(detail::ConsoleColor::RED);
+            default:
+                return {};
+        }
+    }
+
+    template<class Out>
+    static void appendString(Out& buffer, std::string_view string)
+    {
+        buffer.append(string.data(), string.data() + string.size());
+    }
+};
+
+/**
+ * @brief Makes a structured field, a typed key/value pair.
+ * Fields are fmt named arguments, the message may refer to them as {key}.
+ * Text records list them after the message as key=value,
+ * JSON records have them as members of the record object
+ *
+ * @tparam T
+ *
+ * @param [in] key static string
+ * @param [in] value
+ *
+ * @return named argument referring to the value
+ */
+template<class T>
+[[nodiscard]] constexpr auto Field(const char* key, const T& value) noexcept
+{
+    return fmt::arg(key, value);
+}
+
+/**
+ * @class ScopedContext
+ *
+ * @brief Adds a key/value pair to every record the calling thread logs
+ * while the guard lives. The value is formatted once, here, into
+ * preallocated thread-local storage, records copy it as a field.
+ * Up to detail::CONTEXT_CAPACITY pairs may be active on a thread,
+ * the rest are ignored. Guards must be destroyed in reverse order
+ */
+class ScopedContext
+{
+public:
+    /**
+     * @brief Pushes the pair
+     *
+     * @tparam T anything fmt can format
+     *
+     * @param [in] key static string
+     * @param [in] value
+     */
+    template<class T>
+    ScopedContext(const char* key, const T& value) noexcept
+        : m_pushed(detail::GetThreadContext().Push(key, value)) {}
+
+    ~ScopedContext()
+    {
+        if (m_pushed)
+            detail::GetThreadContext().Pop();
+    }
+
+    ScopedContext(const ScopedContext& other) = delete;
+    ScopedContext& operator=(const ScopedContext& other) = delete;
+private:
+    bool m_pushed = false;
+};
+
+namespace detail {
+
+alignas(Logger) inline unsigned char globalLoggerStorage[sizeof(Logger)];
+inline std::atomic<int> globalLoggerUsers{0};
+
+/**
+ * @class GlobalLoggerInit
+ *
+ * @brief Every translation unit including this header has one,
+ * the first constructed makes the global logger and the last destroyed
+ * destroys it, the way std::ios_base::Init keeps std::cout.
+ * So the logger exists before any static of such a unit and
+ * GetGlobalLogger has no guard to check
+ */
+class GlobalLoggerInit
+{
+public:
+    GlobalLoggerInit()
+    {
+        if (globalLoggerUsers.fetch_add(1, std::memory_order_acq_rel) == 0)
+            new (globalLoggerStorage) Logger{stderr};
+    }
+
+    ~GlobalLoggerInit()
+    {
+        if (globalLoggerUsers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            std::launder(reinterpret_cast<Logger*>(globalLoggerStorage))->~Logger();
+    }
+
+    GlobalLoggerInit(const GlobalLoggerInit& other) = delete;
+    GlobalLoggerInit& operator=(const GlobalLoggerInit& other) = delete;
 };
 
+static GlobalLoggerInit globalLoggerInit{};
+
+} // namespace detail
+
 /**
  * @brief Get global logger instance. By default logs to stderr
  *
  * @return Logger& global logger
  */
-inline Logger& GetGlobalLogger()
+inline Logger& GetGlobalLogger() noexcept
 {
-#ifndef DISABLE_LOGGING
-    static Logger globalLogger{stderr};
-
-    return globalLogger;
-#endif // ifndef DISABLE LOGGING
+    return *std::launder(reinterpret_cast<Logger*>(detail::globalLoggerStorage));
 }
 
 /**
@@ -254,12 +2454,97 @@ inline void SetGlobalLoggerLogFile(std::nullptr_t)
 
 } // namespace mlib
 
+/**
+ * @brief With MLIB_LOG_TSC_TIMESTAMPS defined call sites read the CPU tick counter
+ * instead of the system clock, the ticks become wall-clock time when the record is
+ * formatted, on the background thread in async mode
+ */
+#ifdef MLIB_LOG_TSC_TIMESTAMPS
+#define MLIB_LOG_NOW() mlib::detail::CpuTicks{mlib::GetCPUTicks()}
+#else
+#define MLIB_LOG_NOW() std::chrono::system_clock::now()
+#endif
+
+// type may be evaluated twice
 #define Log(type, errorCode, ...) \
-Log(type, errorCode, CURRENT_SOURCE_POSITION(), std::chrono::system_clock::now() __VA_OPT__(, __VA_ARGS__))
+LogIfEnabled(type, CURRENT_SOURCE_POSITION(), [&](auto& mlibLogger_, mlib::detail::SourcePosition mlibPosition_) { \
+    mlibLogger_.Log(type, errorCode, mlibPosition_, MLIB_LOG_NOW() __VA_OPT__(, __VA_ARGS__)); \
+})
 
+#if MLIB_LOG_LEVEL <= MLIB_LOG_LEVEL_INFO
 #define LogInfo(...) Log(mlib::Logger::INFO, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#else
+#define LogInfo(...) Discard()
+#endif
+
+#if MLIB_LOG_LEVEL <= MLIB_LOG_LEVEL_DEBUG
 #define LogDebug(...) Log(mlib::Logger::DEBUG, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#else
+#define LogDebug(...) Discard()
+#endif
+
+#if MLIB_LOG_LEVEL <= MLIB_LOG_LEVEL_ERROR
 #define LogError(errorCode, ...) Log(mlib::Logger::ERROR, errorCode __VA_OPT__(, __VA_ARGS__))
+#else
+#define LogError(...) Discard()
+#endif
+
+// Each expansion owns a static limiter, type may be evaluated twice.
+// The parentheses keep the Log macro from expanding
+#define MLIB_LOG_LIMITED(limit, type, errorCode, ...) \
+LogLimited(type, CURRENT_SOURCE_POSITION(), [&](uint32_t& mlibSuppressed_) { \
+    static mlib::detail::CallSiteLimiter mlibLimiter_{}; \
+    return mlibLimiter_.limit; \
+}, [&](auto& mlibLogger_, mlib::detail::SourcePosition mlibPosition_, uint32_t mlibSuppressed_) { \
+    (mlibLogger_.Log)(type, errorCode, mlibPosition_, \
+                      mlib::Logger::RecordStamp(MLIB_LOG_NOW(), mlibSuppressed_) \
+                      __VA_OPT__(, __VA_ARGS__)); \
+})
+
+/// Logs the first of every n calls of this line
+#define LogEvery(n, type, errorCode, ...) \
+MLIB_LOG_LIMITED(Every(n, mlibSuppressed_), type, errorCode __VA_OPT__(, __VA_ARGS__))
+
+/// Logs at most one call of this line per ms milliseconds
+#define LogEveryMs(ms, type, errorCode, ...) \
+MLIB_LOG_LIMITED(EveryMs(ms, mlibSuppressed_), type, errorCode __VA_OPT__(, __VA_ARGS__))
+
+/// Logs each call of this line with the given probability
+#define LogSampled(probability, type, errorCode, ...) \
+MLIB_LOG_LIMITED(Sample(probability, mlibSuppressed_), type, errorCode __VA_OPT__(, __VA_ARGS__))
+
+#if MLIB_LOG_LEVEL <= MLIB_LOG_LEVEL_INFO
+#define LogInfoEvery(n, ...) LogEvery(n, mlib::Logger::INFO, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#define LogInfoEveryMs(ms, ...) LogEveryMs(ms, mlib::Logger::INFO, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#define LogInfoSampled(probability, ...) \
+LogSampled(probability, mlib::Logger::INFO, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#else
+#define LogInfoEvery(...) Discard()
+#define LogInfoEveryMs(...) Discard()
+#define LogInfoSampled(...) Discard()
+#endif
+
+#if MLIB_LOG_LEVEL <= MLIB_LOG_LEVEL_DEBUG
+#define LogDebugEvery(n, ...) LogEvery(n, mlib::Logger::DEBUG, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#define LogDebugEveryMs(ms, ...) LogEveryMs(ms, mlib::Logger::DEBUG, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#define LogDebugSampled(probability, ...) \
+LogSampled(probability, mlib::Logger::DEBUG, mlib::err::EVERYTHING_FINE __VA_OPT__(, __VA_ARGS__))
+#else
+#define LogDebugEvery(...) Discard()
+#define LogDebugEveryMs(...) Discard()
+#define LogDebugSampled(...) Discard()
+#endif
+
+#if MLIB_LOG_LEVEL <= MLIB_LOG_LEVEL_ERROR
+#define LogErrorEvery(n, errorCode, ...) LogEvery(n, mlib::Logger::ERROR, errorCode __VA_OPT__(, __VA_ARGS__))
+#define LogErrorEveryMs(ms, errorCode, ...) LogEveryMs(ms, mlib::Logger::ERROR, errorCode __VA_OPT__(, __VA_ARGS__))
+#define LogErrorSampled(probability, errorCode, ...) \
+LogSampled(probability, mlib::Logger::ERROR, errorCode __VA_OPT__(, __VA_ARGS__))
+#else
+#define LogErrorEvery(...) Discard()
+#define LogErrorEveryMs(...) Discard()
+#define LogErrorSampled(...) Discard()
+#endif
 
 #ifndef DISABLE_LOGGING
 
@@ -268,6 +2553,19 @@ Log(type, errorCode, CURRENT_SOURCE_POSITION(), std::chrono::system_clock::now()
 #define GlobalLogDebug(...) mlib::GetGlobalLogger(). LogDebug(__VA_ARGS__)
 #define GlobalLogError(errorCode, ...) mlib::GetGlobalLogger(). LogError(errorCode __VA_OPT__(, __VA_ARGS__))
 
+#define GlobalLogEvery(...) mlib::GetGlobalLogger(). LogEvery(__VA_ARGS__)
+#define GlobalLogEveryMs(...) mlib::GetGlobalLogger(). LogEveryMs(__VA_ARGS__)
+#define GlobalLogSampled(...) mlib::GetGlobalLogger(). LogSampled(__VA_ARGS__)
+#define GlobalLogInfoEvery(...) mlib::GetGlobalLogger(). LogInfoEvery(__VA_ARGS__)
+#define GlobalLogInfoEveryMs(...) mlib::GetGlobalLogger(). LogInfoEveryMs(__VA_ARGS__)
+#define GlobalLogInfoSampled(...) mlib::GetGlobalLogger(). LogInfoSampled(__VA_ARGS__)
+#define GlobalLogDebugEvery(...) mlib::GetGlobalLogger(). LogDebugEvery(__VA_ARGS__)
+#define GlobalLogDebugEveryMs(...) mlib::GetGlobalLogger(). LogDebugEveryMs(__VA_ARGS__)
+#define GlobalLogDebugSampled(...) mlib::GetGlobalLogger(). LogDebugSampled(__VA_ARGS__)
+#define GlobalLogErrorEvery(...) mlib::GetGlobalLogger(). LogErrorEvery(__VA_ARGS__)
+#define GlobalLogErrorEveryMs(...) mlib::GetGlobalLogger(). LogErrorEveryMs(__VA_ARGS__)
+#define GlobalLogErrorSampled(...) mlib::GetGlobalLogger(). LogErrorSampled(__VA_ARGS__)
+
 #else
 
 #define GlobalLog(...)
@@ -275,6 +2573,19 @@ Log(type, errorCode, CURRENT_SOURCE_POSITION(), std::chrono::system_clock::now()
 #define GlobalLogDebug(...)
 #define GlobalLogError(...)
 
+#define GlobalLogEvery(...)
+#define GlobalLogEveryMs(...)
+#define GlobalLogSampled(...)
+#define GlobalLogInfoEvery(...)
+#define GlobalLogInfoEveryMs(...)
+#define GlobalLogInfoSampled(...)
+#define GlobalLogDebugEvery(...)
+#define GlobalLogDebugEveryMs(...)
+#define GlobalLogDebugSampled(...)
+#define GlobalLogErrorEvery(...)
+#define GlobalLogErrorEveryMs(...)
+#define GlobalLogErrorSampled(...)
+
 #endif // ifndef DISABLE_LOGGING
 
 #endif // MLIB_LOGGER_HPP
@@ -0,0 +1,1252 @@
+/**
+ * @file Sinks.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Log sinks, places where formatted records go
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_SINKS_HPP
+#define MLIB_LOGGER_SINKS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef __linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "details/BinaryFormat.hpp"
+#include "details/ConsoleColor.hpp"
+#include "details/File.hpp"
+#include "details/IoUring.hpp"
+#include "details/LogType.hpp"
+
+namespace mlib {
+
+/**
+ * @struct SinkRecord
+ *
+ * @brief A record formatted once and shared by all sinks
+ */
+struct SinkRecord
+{
+    detail::LogType  type = detail::INFO;
+
+    /// File header or binary SITE entry, every sink takes it regardless of level
+    bool             metadata = false;
+
+    /// Record with console color escapes
+    std::string_view colored{};
+
+    /// The same bytes without the escapes, a view into colored
+    std::string_view plain{};
+};
+
+/**
+ * @class Sink
+ *
+ * @brief Base class of log destinations.
+ *
+ * A Logger formats a record once and passes the same bytes to every sink
+ * whose level accepts it. A Logger never calls Write or Flush of one sink
+ * concurrently unless the sink is concurrent, a sink shared by several loggers
+ * has to synchronize itself.
+ */
+class Sink
+{
+public:
+    virtual ~Sink() = default;
+
+    /**
+     * @brief Writes a record
+     *
+     * @param [in] record
+     */
+    virtual void Write(const SinkRecord& record) = 0;
+
+    /**
+     * @brief Flushes buffered records if there are any
+     */
+    virtual void Flush() {}
+
+    /**
+     * @brief Waits until the records written so far survive a power loss,
+     * fdatasync for files. Unlike Write and Flush it may be called
+     * concurrently with them. Sinks that keep nothing on disk do nothing
+     */
+    virtual void Sync() {}
+
+    /**
+     * @brief Tells if Write may be called concurrently with itself and Flush.
+     * A Logger whose sinks are all concurrent writes text and JSON records
+     * without its mutex, unless the flight recorder is on
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] virtual bool IsConcurrent() const noexcept { return false; }
+
+    /**
+     * @brief Sets the minimum type of records this sink takes
+     *
+     * @param [in] minType
+     */
+    void SetLevel(detail::LogType minType) noexcept
+    {
+        m_level.store(minType, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the minimum type of records this sink takes
+     *
+     * @return detail::LogType
+     */
+    [[nodiscard]] detail::LogType GetLevel() const noexcept
+    {
+        return m_level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Tells if the sink takes the record
+     *
+     * @param [in] record
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool Accepts(const SinkRecord& record) const noexcept
+    {
+        return record.metadata || record.type >= m_level.load(std::memory_order_relaxed);
+    }
+private:
+    std::atomic<detail::LogType> m_level{detail::DEBUG};
+};
+
+/**
+ * @class FileSink
+ *
+ * @brief Writes records without colors to a file, one write(2) per record.
+ * Owns the file, closes it unless it is a standard stream
+ */
+class FileSink : public Sink
+{
+public:
+    /**
+     * @brief Takes an open file
+     *
+     * @param [in] file
+     */
+    explicit FileSink(FILE* file) noexcept
+        : m_file(file)
+    {
+        if (file)
+            std::setbuf(file, nullptr);
+    }
+
+    /**
+     * @brief Opens a file at the given path. "w" truncates it, for a log
+     * of one process. A file shared by processes needs "a": O_APPEND moves
+     * every write(2) to the end, so records of different processes do not interleave
+     *
+     * @param [in] path
+     * @param [in] mode fopen mode
+     */
+    explicit FileSink(const char* path, const char* mode = "w") noexcept
+        : FileSink(std::fopen(path, mode)) {}
+
+    /**
+     * @brief Tells if the file is open
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsOpen() noexcept { return m_file; }
+
+    void Write(const SinkRecord& record) override
+    {
+        if (m_file)
+            m_file.Write(record.plain.data(), record.plain.size());
+    }
+
+    void Flush() override
+    {
+        if (m_file)
+            m_file.Flush();
+    }
+
+    void Sync() override
+    {
+        if (m_file)
+            m_file.Sync();
+    }
+protected:
+    detail::File m_file;
+};
+
+/**
+ * @class ConsoleSink
+ *
+ * @brief Writes records to a stream, colored if it is a terminal.
+ * The stream is checked once, when the sink is made
+ */
+class ConsoleSink : public FileSink
+{
+public:
+    /**
+     * @brief ConsoleSink(FILE* stream = stderr, ColorMode mode = ColorMode::AUTO)
+     *
+     * @param [in] stream
+     * @param [in] mode
+     */
+    explicit ConsoleSink(FILE* stream = stderr, detail::ColorMode mode = detail::ColorMode::AUTO) noexcept
+        : FileSink(stream), m_colored(detail::ResolveColors(stream, mode)) {}
+
+    /**
+     * @brief Decides again if records are colored
+     *
+     * @param [in] mode
+     */
+    void SetColorMode(detail::ColorMode mode) noexcept
+    {
+        m_colored.store(detail::ResolveColors(m_file, mode), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Tells if records are colored
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsColored() const noexcept { return m_colored.load(std::memory_order_relaxed); }
+
+    void Write(const SinkRecord& record) override
+    {
+        if (!m_file) return;
+
+        std::string_view bytes = IsColored() ? record.colored : record.plain;
+        m_file.Write(bytes.data(), bytes.size());
+    }
+private:
+    std::atomic<bool> m_colored;
+};
+
+/**
+ * @class RotatingFileSink
+ *
+ * @brief Writes records without colors to a file and rotates it
+ * by size, by time or both.
+ *
+ * On rotation "path" becomes "path.1", "path.1" becomes "path.2" and so on,
+ * files past the retained count are removed. A helper thread keeps the next
+ * file open in advance as "path.next" and does all renames, so the writer only
+ * swaps two pointers. If the helper is still busy the writer keeps writing
+ * to the current file and rotates on a later record.
+ * Binary file headers and sites are replayed at the start of each new file,
+ * so every rotated binary log can be decoded on its own.
+ */
+class RotatingFileSink : public Sink
+{
+public:
+    using Interval = std::chrono::seconds;
+
+    /**
+     * @brief Opens the file at the given path for appending
+     *
+     * @param [in] path
+     * @param [in] maxSize rotate before a record makes the file larger, 0 to disable
+     * @param [in] maxFiles how many rotated files are kept
+     * @param [in] interval rotate when the file is older, zero to disable
+     */
+    RotatingFileSink(const char* path, size_t maxSize, size_t maxFiles,
+                     Interval interval = Interval::zero())
+        : m_path(path), m_maxSize(maxSize), m_maxFiles(maxFiles), m_interval(interval)
+    {
+        auto file = openFile(path, "a");
+
+        if (!*file) return;
+
+        std::fseek(*file, 0, SEEK_END);
+        long size = std::ftell(*file);
+
+        m_file     = std::move(file);
+        m_size     = size > 0 ? static_cast<size_t>(size) : 0;
+        m_openedAt = std::chrono::steady_clock::now();
+        m_thread   = std::thread(&RotatingFileSink::rotationWorker, this);
+    }
+
+    ~RotatingFileSink() override
+    {
+        if (!m_thread.joinable()) return;
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_one();
+        m_thread.join();
+
+        if (m_spare)
+        {
+            m_spare.reset();
+            std::remove(nextPath().c_str());
+        }
+    }
+
+    RotatingFileSink(const RotatingFileSink& other) = delete;
+    RotatingFileSink& operator=(const RotatingFileSink& other) = delete;
+
+    /**
+     * @brief Tells if the file is open
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsOpen() const noexcept { return m_file != nullptr; }
+
+    void Write(const SinkRecord& record) override
+    {
+        if (!m_file) return;
+
+        std::string_view bytes = record.plain;
+
+        if (record.metadata)
+            rememberMetadata(bytes);
+        else if (shouldRotate(bytes.size()))
+            tryRotate();
+
+        m_file->Write(bytes.data(), bytes.size());
+        m_size += bytes.size();
+    }
+
+    void Flush() override
+    {
+        if (m_file)
+            m_file->Flush();
+    }
+
+    /**
+     * @brief Syncs the files rotated since the last call and the current one.
+     * Once Sync has been called rotated files stay open until the next call
+     * syncs them, before that rotation costs no sync. The mutex is not held
+     * during the sync, the writer may rotate meanwhile
+     */
+    void Sync() override
+    {
+        std::vector<std::shared_ptr<detail::File>> files{};
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            m_syncing = true;
+            files.swap(m_unsynced);
+
+            if (m_file)
+                files.push_back(m_file);
+        }
+
+        for (const std::shared_ptr<detail::File>& file : files)
+            file->Sync();
+    }
+private:
+    static constexpr std::chrono::seconds OPEN_RETRY_DELAY{1};
+
+    const std::string                     m_path;
+    const size_t                          m_maxSize;
+    const size_t                          m_maxFiles;
+    const Interval                        m_interval;
+
+    // Written by the writer, replaced under the mutex, Sync shares it
+    std::shared_ptr<detail::File>         m_file{};
+    size_t                                m_size = 0;
+    std::chrono::steady_clock::time_point m_openedAt{};
+    std::string                           m_metadata{};
+
+    // Shared with the rotation thread
+    std::mutex                            m_mutex{};
+    std::condition_variable               m_condition{};
+    std::unique_ptr<detail::File>         m_spare{};
+    std::shared_ptr<detail::File>         m_retired{};
+    /// Rotated files the next Sync has to sync, kept only once Sync has been called
+    std::vector<std::shared_ptr<detail::File>> m_unsynced{};
+    bool                                  m_syncing = false;
+    bool                                  m_stop = false;
+    std::thread                           m_thread{};
+
+    static std::unique_ptr<detail::File> openFile(const char* path, const char* mode)
+    {
+        auto file = std::make_unique<detail::File>(path, mode);
+
+        if (*file)
+            std::setbuf(*file, nullptr);
+
+        return file;
+    }
+
+    [[nodiscard]] std::string nextPath() const
+    {
+        return m_path + ".next";
+    }
+
+    [[nodiscard]] std::string rotatedPath(size_t index) const
+    {
+        return m_path + "." + std::to_string(index);
+    }
+
+    void rememberMetadata(std::string_view bytes)
+    {
+        std::string_view magic{detail::BINARY_LOG_MAGIC, sizeof(detail::BINARY_LOG_MAGIC)};
+
+        if (bytes.substr(0, magic.size()) == magic)
+            m_metadata.clear();
+
+        m_metadata.append(bytes);
+    }
+
+    [[nodiscard]] bool shouldRotate(size_t recordSize) const noexcept
+    {
+        if (m_maxSize != 0 && m_size != 0 && m_size + recordSize > m_maxSize)
+            return true;
+
+        return m_interval != Interval::zero() &&
+               std::chrono::steady_clock::now() - m_openedAt >= m_interval;
+    }
+
+    void tryRotate()
+    {
+        std::unique_ptr<detail::File> next{};
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            if (!m_spare || m_retired) return;
+
+            next = std::move(m_spare);
+        }
+
+        next->Write(m_metadata.data(), m_metadata.size());
+
+        {
+            std::unique_lock lock(m_mutex);
+            if (m_syncing)
+                m_unsynced.push_back(m_file);
+
+            m_retired = std::move(m_file);
+            m_file    = std::move(next);
+        }
+
+        m_size     = m_metadata.size();
+        m_openedAt = std::chrono::steady_clock::now();
+
+        m_condition.notify_one();
+    }
+
+    void shiftFiles()
+    {
+        if (m_maxFiles == 0)
+        {
+            std::remove(m_path.c_str());
+        }
+        else
+        {
+            std::remove(rotatedPath(m_maxFiles).c_str());
+
+            for (size_t i = m_maxFiles - 1; i > 0; i--)
+                std::rename(rotatedPath(i).c_str(), rotatedPath(i + 1).c_str());
+
+            std::rename(m_path.c_str(), rotatedPath(1).c_str());
+        }
+
+        std::rename(nextPath().c_str(), m_path.c_str());
+    }
+
+    void rotationWorker()
+    {
+        std::unique_lock lock(m_mutex);
+
+        for (;;)
+        {
+            m_condition.wait(lock, [this] { return m_stop || m_retired || !m_spare; });
+
+            if (m_retired)
+            {
+                std::shared_ptr<detail::File> retired = std::move(m_retired);
+
+                lock.unlock();
+                retired.reset();
+                shiftFiles();
+                lock.lock();
+
+                continue;
+            }
+
+            if (m_stop) break;
+
+            lock.unlock();
+            std::unique_ptr<detail::File> spare = openFile(nextPath().c_str(), "w");
+            lock.lock();
+
+            if (*spare)
+                m_spare = std::move(spare);
+            else
+                m_condition.wait_for(lock, OPEN_RETRY_DELAY, [this] { return m_stop; });
+        }
+    }
+};
+
+#ifdef __linux
+
+/**
+ * @class UringFileSink
+ *
+ * @brief Writes records without colors to a file through io_uring.
+ *
+ * Records are copied into a few preallocated buffers registered with the
+ * kernel. A full buffer is submitted right away, a partial one when no write
+ * is in flight, so records batch up while the disk is busy. A completion
+ * thread recycles the buffers, Write only waits when all of them are
+ * in flight. If the kernel has no io_uring the same thread writes
+ * the buffers with pwrite(2) instead.
+ */
+class UringFileSink : public Sink
+{
+public:
+    static constexpr size_t DEFAULT_BUFFER_SIZE  = 64 * 1024;
+    static constexpr size_t DEFAULT_BUFFER_COUNT = 8;
+    static constexpr size_t MAX_BUFFER_COUNT     = 1024;
+
+    /**
+     * @brief Creates or truncates the file at the given path
+     *
+     * @param [in] path
+     * @param [in] bufferSize
+     * @param [in] bufferCount at most MAX_BUFFER_COUNT
+     */
+    explicit UringFileSink(const char* path, size_t bufferSize = DEFAULT_BUFFER_SIZE,
+                           size_t bufferCount = DEFAULT_BUFFER_COUNT)
+        : m_bufferSize(std::clamp<size_t>(bufferSize, 1, UINT32_MAX)),
+          m_bufferCount(std::clamp<size_t>(bufferCount, 1, MAX_BUFFER_COUNT)),
+          m_memory(new char[m_bufferSize * m_bufferCount]),
+          m_slots(m_bufferCount),
+          m_ring(static_cast<unsigned>(m_bufferCount + 1))
+    {
+        m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_fd < 0) return;
+
+        for (size_t i = m_bufferCount; i > 0; i--)
+            m_free.push_back(static_cast<uint32_t>(i - 1));
+
+        if (m_ring.IsOpen())
+        {
+            std::vector<iovec> buffers(m_bufferCount);
+
+            for (size_t i = 0; i < m_bufferCount; i++)
+                buffers[i] = iovec{buffer(static_cast<uint32_t>(i)), m_bufferSize};
+
+            m_registered = m_ring.RegisterBuffers(buffers.data(), static_cast<unsigned>(m_bufferCount));
+            m_thread = std::thread(&UringFileSink::completionWorker, this);
+        }
+        else
+        {
+            m_thread = std::thread(&UringFileSink::writeWorker, this);
+        }
+    }
+
+    ~UringFileSink() override
+    {
+        if (m_fd < 0) return;
+
+        Flush();
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_stop = true;
+
+            // The completion thread only stops on this request, it has to get through
+            while (m_ring.IsOpen() && !(m_ring.PrepareNop(STOP_REQUEST) && m_ring.Submit()))
+            {
+                m_ring.DropQueued();
+                std::this_thread::sleep_for(WAIT_RETRY_DELAY);
+            }
+        }
+
+        m_condition.notify_all();
+        m_thread.join();
+
+        ::close(m_fd);
+    }
+
+    UringFileSink(const UringFileSink& other) = delete;
+    UringFileSink& operator=(const UringFileSink& other) = delete;
+
+    /**
+     * @brief Tells if the file is open
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsOpen() const noexcept { return m_fd >= 0; }
+
+    /**
+     * @brief Tells if writes go through io_uring, not the pwrite fallback
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool UsesIoUring() const noexcept { return m_fd >= 0 && m_ring.IsOpen(); }
+
+    void Write(const SinkRecord& record) override
+    {
+        if (m_fd < 0) return;
+
+        std::string_view bytes = record.plain;
+
+        std::unique_lock lock(m_mutex);
+
+        while (!bytes.empty())
+        {
+            if (m_current == NO_BUFFER)
+            {
+                m_condition.wait(lock, [this] { return !m_free.empty(); });
+
+                m_current = m_free.back();
+                m_free.pop_back();
+            }
+
+            Slot& slot = m_slots[m_current];
+            size_t chunk = std::min(bytes.size(), m_bufferSize - slot.size);
+
+            std::memcpy(buffer(m_current) + slot.size, bytes.data(), chunk);
+            slot.size += static_cast<uint32_t>(chunk);
+            bytes.remove_prefix(chunk);
+
+            if (slot.size == m_bufferSize)
+                submitCurrent();
+        }
+
+        if (m_inFlight == 0)
+            submitCurrent();
+    }
+
+    /**
+     * @brief Waits until everything written so far is in the file
+     */
+    void Flush() override
+    {
+        if (m_fd < 0) return;
+
+        std::unique_lock lock(m_mutex);
+
+        submitCurrent();
+        m_condition.wait(lock, [this] { return m_inFlight == 0 && m_current == NO_BUFFER; });
+    }
+
+    /**
+     * @brief Submits the partial buffer, waits for the writes
+     * submitted before the call and syncs the file
+     */
+    void Sync() override
+    {
+        if (m_fd < 0) return;
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            submitCurrent();
+
+            uint64_t end = m_offset;
+
+            m_condition.wait(lock, [this, end] { return !hasWriteBefore(end); });
+        }
+
+        ::fdatasync(m_fd);
+    }
+private:
+    static constexpr uint32_t NO_BUFFER    = UINT32_MAX;
+    static constexpr uint64_t STOP_REQUEST = UINT64_MAX;
+
+    static constexpr std::chrono::milliseconds WAIT_RETRY_DELAY{1};
+    static constexpr int                       SUBMIT_ATTEMPTS = 3;
+
+    struct Slot
+    {
+        uint32_t size = 0;
+        uint32_t written = 0;
+        uint64_t offset = 0;
+    };
+
+    const size_t            m_bufferSize;
+    const size_t            m_bufferCount;
+    std::unique_ptr<char[]> m_memory;
+    int                     m_fd = -1;
+
+    std::mutex              m_mutex{};
+    std::condition_variable m_condition{};
+    std::vector<Slot>       m_slots;
+    std::vector<uint32_t>   m_free{};
+    std::deque<uint32_t>    m_pending{}; ///< submitted buffers of the pwrite fallback
+    uint32_t                m_current = NO_BUFFER;
+    size_t                  m_inFlight = 0;
+    uint64_t                m_offset = 0;
+    bool                    m_stop = false;
+
+    detail::IoUring         m_ring;
+    bool                    m_registered = false;
+    std::thread             m_thread{};
+
+    char* buffer(uint32_t index) const noexcept
+    {
+        return m_memory.get() + index * m_bufferSize;
+    }
+
+    /// Called under the lock, tells if a submitted buffer starting before the offset is not written yet
+    [[nodiscard]] bool hasWriteBefore(uint64_t offset) const noexcept
+    {
+        for (uint32_t i = 0; i < m_bufferCount; i++)
+            if (i != m_current && m_slots[i].size != 0 && m_slots[i].offset < offset)
+                return true;
+
+        return false;
+    }
+
+    /// Called under the lock
+    void submitCurrent()
+    {
+        if (m_current == NO_BUFFER) return;
+
+        uint32_t index = m_current;
+        Slot& slot = m_slots[index];
+
+        m_current    = NO_BUFFER;
+        slot.written = 0;
+        slot.offset  = m_offset;
+
+        m_offset += slot.size;
+        m_inFlight++;
+
+        submit(index);
+    }
+
+    /// Called under the lock, submits the unwritten rest of a buffer
+    void submit(uint32_t index)
+    {
+        const Slot& slot = m_slots[index];
+
+        if (m_ring.IsOpen())
+        {
+            // Nothing stays queued after this, so a refused request is the only one
+            for (int attempt = 0; attempt < SUBMIT_ATTEMPTS; attempt++)
+            {
+                if (m_ring.PrepareWrite(m_fd, buffer(index) + slot.written, slot.size - slot.written,
+                                        slot.offset + slot.written, m_registered ? static_cast<int>(index) : -1,
+                                        index) &&
+                    m_ring.Submit())
+                    return;
+
+                m_ring.DropQueued();
+                std::this_thread::yield();
+            }
+
+            // The kernel keeps refusing, the buffer is written here so waiters do not hang
+            ssize_t written = ::pwrite(m_fd, buffer(index) + slot.written, slot.size - slot.written,
+                                       static_cast<off_t>(slot.offset + slot.written));
+
+            finishWrite(index, written < 0 ? -errno : static_cast<int32_t>(written));
+            return;
+        }
+
+        m_pending.push_back(index);
+        m_condition.notify_all();
+    }
+
+    /// Called under the lock with the result of a write
+    void finishWrite(uint32_t index, int32_t result)
+    {
+        Slot& slot = m_slots[index];
+
+        if (result > 0)
+            slot.written += static_cast<uint32_t>(result);
+
+        if ((result > 0 && slot.written < slot.size) || result == -EINTR || result == -EAGAIN)
+        {
+            submit(index);
+            return;
+        }
+
+        // Written or failed, a failed buffer is lost like a failed write(2) of FileSink
+        slot.size = 0;
+        m_free.push_back(index);
+        m_inFlight--;
+
+        if (m_inFlight == 0)
+            submitCurrent();
+
+        m_condition.notify_all();
+    }
+
+    void completionWorker() noexcept
+    {
+        for (;;)
+        {
+            detail::IoCompletion completion{};
+
+            // The error may last, do not spin on it
+            if (!m_ring.WaitCompletion(completion))
+            {
+                std::this_thread::sleep_for(WAIT_RETRY_DELAY);
+                continue;
+            }
+
+            if (completion.userData == STOP_REQUEST)
+                break;
+
+            std::unique_lock lock(m_mutex);
+            finishWrite(static_cast<uint32_t>(completion.userData), completion.result);
+        }
+    }
+
+    void writeWorker() noexcept
+    {
+        std::unique_lock lock(m_mutex);
+
+        for (;;)
+        {
+            m_condition.wait(lock, [this] { return m_stop || !m_pending.empty(); });
+
+            if (m_pending.empty()) break;
+
+            uint32_t index = m_pending.front();
+            m_pending.pop_front();
+
+            const Slot& slot = m_slots[index];
+
+            lock.unlock();
+
+            ssize_t written = ::pwrite(m_fd, buffer(index) + slot.written, slot.size - slot.written,
+                                       static_cast<off_t>(slot.offset + slot.written));
+            int32_t result = written < 0 ? -errno : static_cast<int32_t>(written);
+
+            lock.lock();
+
+            finishWrite(index, result);
+        }
+    }
+};
+
+/**
+ * @class MappedFileSink
+ *
+ * @brief Copies records straight into a memory-mapped file.
+ *
+ * The file is preallocated and mapped in large extents. A writer reserves
+ * space with one atomic add on the cursor and copies the record into the
+ * mapping, there is no syscall per record and writers do not lock each other.
+ * The next extent is mapped in advance by a helper thread, it replaces
+ * an extent once every byte of it is written. Records are visible to readers
+ * of the file at once, the preallocated tail is cut off when the sink closes.
+ */
+class MappedFileSink : public Sink
+{
+public:
+    static constexpr size_t DEFAULT_EXTENT_SIZE = 64 << 20;
+
+    /**
+     * @brief Creates or truncates the file at the given path
+     *
+     * @param [in] path
+     * @param [in] extentSize rounded up to whole pages
+     */
+    explicit MappedFileSink(const char* path, size_t extentSize = DEFAULT_EXTENT_SIZE)
+        : m_extentSize(roundToPages(extentSize))
+    {
+        m_fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_fd < 0) return;
+
+        for (uint64_t extent = 0; extent < SLOT_COUNT; extent++)
+        {
+            Slot& slot = m_slots[extent];
+
+            slot.data = mapExtent(extent);
+
+            if (!slot.data)
+            {
+                unmapAll();
+                ::close(m_fd);
+                m_fd = -1;
+                return;
+            }
+
+            slot.extent.store(extent, std::memory_order_relaxed);
+        }
+
+        m_thread = std::thread(&MappedFileSink::mapWorker, this);
+    }
+
+    ~MappedFileSink() override
+    {
+        if (m_fd < 0) return;
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_one();
+        m_thread.join();
+
+        unmapAll();
+
+        uint64_t end = m_cursor.load(std::memory_order_relaxed);
+
+        // Nothing was written from the extent that could not be mapped on
+        if (m_failedExtent != FAILED_EXTENT)
+            end = std::min(end, m_failedExtent * m_extentSize);
+
+        if (::ftruncate(m_fd, static_cast<off_t>(end)) != 0)
+        {
+            // The preallocated tail stays, it is only zeros
+        }
+
+        ::close(m_fd);
+    }
+
+    MappedFileSink(const MappedFileSink& other) = delete;
+    MappedFileSink& operator=(const MappedFileSink& other) = delete;
+
+    /**
+     * @brief Tells if the file is open
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsOpen() const noexcept { return m_fd >= 0; }
+
+    [[nodiscard]] bool IsConcurrent() const noexcept override { return true; }
+
+    /**
+     * @brief Copies the record into the mapping, may be called concurrently.
+     * Waits only if the helper thread has not mapped the extent yet
+     *
+     * @param [in] record
+     */
+    void Write(const SinkRecord& record) override
+    {
+        if (m_fd < 0) return;
+
+        std::string_view bytes = record.plain;
+        uint64_t offset = m_cursor.fetch_add(bytes.size(), std::memory_order_relaxed);
+
+        while (!bytes.empty())
+        {
+            uint64_t extent   = offset / m_extentSize;
+            size_t   inExtent = offset % m_extentSize;
+            size_t   chunk    = std::min(bytes.size(), m_extentSize - inExtent);
+            Slot&    slot     = m_slots[extent % SLOT_COUNT];
+
+            if (char* data = waitMapped(slot, extent))
+            {
+                std::memcpy(data + inExtent, bytes.data(), chunk);
+
+                if (slot.written.fetch_add(chunk, std::memory_order_acq_rel) + chunk == m_extentSize)
+                    retire();
+            }
+
+            bytes.remove_prefix(chunk);
+            offset += chunk;
+        }
+    }
+
+    /**
+     * @brief Syncs the file, the kernel writes back the pages dirtied through the mapping
+     */
+    void Sync() override
+    {
+        if (m_fd >= 0)
+            ::fdatasync(m_fd);
+    }
+private:
+    static constexpr size_t   SLOT_COUNT    = 2;
+    static constexpr uint64_t FAILED_EXTENT = UINT64_MAX;
+
+    struct Slot
+    {
+        char*                 data = nullptr;
+        std::atomic<uint64_t> extent{FAILED_EXTENT};
+        std::atomic<size_t>   written{0};
+    };
+
+    const size_t            m_extentSize;
+    int                     m_fd = -1;
+
+    Slot                    m_slots[SLOT_COUNT]{};
+    std::atomic<uint64_t>   m_cursor{0};
+    std::atomic<bool>       m_failed{false};
+    /// Set by the helper thread, read after it is joined
+    uint64_t                m_failedExtent = FAILED_EXTENT;
+
+    std::mutex              m_mutex{};
+    std::condition_variable m_condition{};
+    bool                    m_retired = false;
+    bool                    m_stop = false;
+    std::thread             m_thread{};
+
+    static size_t roundToPages(size_t size) noexcept
+    {
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+
+        return std::max<size_t>((size + page - 1) / page, 1) * page;
+    }
+
+    /// Allocates disk blocks first, so writes to the mapping never fault on a full disk
+    char* mapExtent(uint64_t extent) noexcept
+    {
+        off_t offset = static_cast<off_t>(extent * m_extentSize);
+
+        if (::posix_fallocate(m_fd, offset, static_cast<off_t>(m_extentSize)) != 0)
+            return nullptr;
+
+        void* data = ::mmap(nullptr, m_extentSize, PROT_WRITE, MAP_SHARED, m_fd, offset);
+
+        return data == MAP_FAILED ? nullptr : static_cast<char*>(data);
+    }
+
+    void unmapAll() noexcept
+    {
+        for (Slot& slot : m_slots)
+        {
+            if (slot.data)
+                ::munmap(slot.data, m_extentSize);
+
+            slot.data = nullptr;
+        }
+    }
+
+    /// nullptr if mapping failed, the record is lost then
+    char* waitMapped(Slot& slot, uint64_t extent) const noexcept
+    {
+        for (;;)
+        {
+            uint64_t mapped = slot.extent.load(std::memory_order_acquire);
+
+            if (mapped == extent)
+                return slot.data;
+
+            if (m_failed.load(std::memory_order_acquire))
+                return nullptr;
+
+            slot.extent.wait(mapped, std::memory_order_acquire);
+        }
+    }
+
+    void retire()
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_retired = true;
+        }
+
+        m_condition.notify_one();
+    }
+
+    void fail(uint64_t extent) noexcept
+    {
+        m_failedExtent = extent;
+        m_failed.store(true, std::memory_order_release);
+
+        for (Slot& slot : m_slots)
+        {
+            slot.extent.store(FAILED_EXTENT, std::memory_order_release);
+            slot.extent.notify_all();
+        }
+    }
+
+    void mapWorker() noexcept
+    {
+        std::unique_lock lock(m_mutex);
+
+        for (;;)
+        {
+            m_condition.wait(lock, [this] { return m_stop || m_retired; });
+
+            if (m_stop) break;
+
+            m_retired = false;
+            lock.unlock();
+
+            for (Slot& slot : m_slots)
+            {
+                if (slot.written.load(std::memory_order_acquire) != m_extentSize)
+                    continue;
+
+                uint64_t next = slot.extent.load(std::memory_order_relaxed) + SLOT_COUNT;
+
+                ::munmap(slot.data, m_extentSize);
+                slot.data = mapExtent(next);
+
+                if (!slot.data)
+                {
+                    fail(next);
+                    return;
+                }
+
+                slot.written.store(0, std::memory_order_relaxed);
+                slot.extent.store(next, std::memory_order_release);
+                slot.extent.notify_all();
+            }
+
+            lock.lock();
+        }
+    }
+};
+
+#endif // ifdef __linux
+
+/**
+ * @class RingSink
+ *
+ * @brief Keeps the most recent records in a preallocated in-memory ring.
+ * Older records are dropped whole when a new one does not fit
+ */
+class RingSink : public Sink
+{
+public:
+    /**
+     * @brief Construct a ring
+     *
+     * @param [in] capacity in bytes
+     */
+    explicit RingSink(size_t capacity)
+        : m_capacity(capacity), m_ring(new char[capacity]) {}
+
+    void Write(const SinkRecord& record) override
+    {
+        if (record.metadata) return;
+
+        std::string_view bytes = record.plain;
+        size_t needed = sizeof(uint32_t) + bytes.size();
+
+        std::unique_lock lock(m_mutex);
+
+        if (needed > m_capacity) return;
+
+        while (m_capacity - m_used < needed)
+            dropOldest();
+
+        uint32_t size = static_cast<uint32_t>(bytes.size());
+        put(reinterpret_cast<const char*>(&size), sizeof(size));
+        put(bytes.data(), bytes.size());
+
+        m_used += needed;
+    }
+
+    /**
+     * @brief Returns the records in the ring, oldest first
+     *
+     * @return std::string
+     */
+    [[nodiscard]] std::string Snapshot() const
+    {
+        std::unique_lock lock(m_mutex);
+
+        std::string result;
+        result.reserve(m_used);
+
+        for (size_t pos = m_head, left = m_used; left > 0;)
+        {
+            uint32_t size = 0;
+            get(pos, reinterpret_cast<char*>(&size), sizeof(size));
+            pos = (pos + sizeof(size)) % m_capacity;
+
+            size_t start = result.size();
+            result.resize(start + size);
+            get(pos, result.data() + start, size);
+            pos = (pos + size) % m_capacity;
+
+            left -= sizeof(size) + size;
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Drops all records
+     */
+    void Clear() noexcept
+    {
+        std::unique_lock lock(m_mutex);
+
+        m_head = m_tail = m_used = 0;
+    }
+private:
+    const size_t            m_capacity;
+    std::unique_ptr<char[]> m_ring;
+    size_t                  m_head = 0;
+    size_t                  m_tail = 0;
+    size_t                  m_used = 0;
+    mutable std::mutex      m_mutex{};
+
+    void put(const char* data, size_t size) noexcept
+    {
+        size_t first = std::min(size, m_capacity - m_tail);
+
+        std::memcpy(m_ring.get() + m_tail, data, first);
+        std::memcpy(m_ring.get(), data + first, size - first);
+
+        m_tail = (m_tail + size) % m_capacity;
+    }
+
+    void get(size_t pos, char* data, size_t size) const noexcept
+    {
+        size_t first = std::min(size, m_capacity - pos);
+
+        std::memcpy(data, m_ring.get() + pos, first);
+        std::memcpy(data + first, m_ring.get(), size - first);
+    }
+
+    void dropOldest() noexcept
+    {
+        uint32_t size = 0;
+        get(m_head, reinterpret_cast<char*>(&size), sizeof(size));
+
+        m_head = (m_head + sizeof(size) + size) % m_capacity;
+        m_used -= sizeof(size) + size;
+    }
+};
+
+/**
+ * @class NullSink
+ *
+ * @brief Discards everything
+ */
+class NullSink : public Sink
+{
+public:
+    void Write(const SinkRecord&) override {}
+};
+
+} // namespace mlib
+
+#endif // MLIB_LOGGER_SINKS_HPP
+
+// NOLINTEND
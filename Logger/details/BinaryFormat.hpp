@@ -0,0 +1,746 @@
+/**
+ * @file BinaryFormat.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Binary log format
+ *
+ * A binary log is a file header followed by entries.
+ * All integers are native endian.
+ *
+ * File header:  char magic[8] "MLIBBLOG" | u32 version | u32 reserved
+ * Entry:        u32 size (whole entry) | u8 kind | payload
+ * SITE payload: u32 siteId | u32 line | u32 fileSize | u32 functionSize
+ *               | u32 formatSize | u8 hasFormat | file | function | format
+ * RECORD payload: u32 siteId | u8 type | u8 flags | i32 errorCode
+ *                 | i64 time (ns since epoch) | u8 argCount
+ *                 | [u32 suppressed if BINARY_RECORD_SUPPRESSED] | args
+ * Argument:     u8 BinaryArgType | value
+ *
+ * A SITE entry is written once per file before the first record of the site,
+ * so strings known at compile time are never repeated. Site ids are below BINARY_MAX_SITES.
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_BINARY_FORMAT_HPP
+#define MLIB_LOGGER_BINARY_FORMAT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <fmt/args.h>
+#include <fmt/format.h>
+#include "FmtTraits.hpp"
+
+namespace mlib {
+namespace detail {
+
+inline constexpr char     BINARY_LOG_MAGIC[8]  = {'M', 'L', 'I', 'B', 'B', 'L', 'O', 'G'};
+inline constexpr uint32_t BINARY_LOG_VERSION   = 1;
+inline constexpr uint32_t BINARY_INVALID_SITE  = UINT32_MAX;
+/// Site ids are below it, a SITE entry with a larger one is corrupted
+inline constexpr uint32_t BINARY_MAX_SITES     = 4096;
+
+inline constexpr size_t BINARY_FILE_HEADER_SIZE   = sizeof(BINARY_LOG_MAGIC) + 2 * sizeof(uint32_t);
+inline constexpr size_t BINARY_ENTRY_HEADER_SIZE  = sizeof(uint32_t) + sizeof(uint8_t);
+inline constexpr size_t BINARY_RECORD_HEADER_SIZE = sizeof(uint32_t) + 2 * sizeof(uint8_t)
+                                                  + sizeof(int32_t) + sizeof(int64_t) + sizeof(uint8_t);
+
+/** @enum BinaryEntryKind
+ * @brief Kinds of binary log entries
+ */
+enum class BinaryEntryKind : uint8_t
+{
+    SITE   = 1,
+    RECORD = 2,
+};
+
+/** @enum BinaryRecordFlags
+ * @brief Bits of the RECORD flags byte
+ */
+enum BinaryRecordFlags : uint8_t
+{
+    BINARY_RECORD_TRUNCATED  = 1, ///< arguments did not fit and were dropped
+    BINARY_RECORD_SUPPRESSED = 2, ///< a suppressed count follows argCount
+};
+
+/** @enum BinaryArgType
+ * @brief Tags of encoded arguments
+ */
+enum class BinaryArgType : uint8_t
+{
+    BOOL,    ///< u8
+    CHAR,    ///< u8
+    INT,     ///< i64
+    UINT,    ///< u64
+    DOUBLE,  ///< f64
+    STRING,  ///< u32 size | bytes
+    POINTER, ///< u64
+    NAMED,   ///< u32 name size | name | '\0' | argument, a structured field
+};
+
+/**
+ * @class BinaryBufferOut
+ *
+ * @brief Growing output for the binary encoder
+ */
+class BinaryBufferOut
+{
+public:
+    explicit BinaryBufferOut(fmt::memory_buffer& buffer) noexcept
+        : m_buffer(buffer) {}
+
+    void Append(const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        m_buffer.append(bytes, bytes + size);
+    }
+
+    template<class Format, class... Args>
+    void AppendFormatted(size_t, const Format& formatString, Args&&... args)
+    {
+        fmt::format_to(std::back_inserter(m_buffer), formatString, std::forward<Args>(args)...);
+    }
+
+    [[nodiscard]] size_t Size() const noexcept { return m_buffer.size(); }
+    [[nodiscard]] bool Overflowed() const noexcept { return false; }
+private:
+    fmt::memory_buffer& m_buffer;
+};
+
+/**
+ * @class BinaryFixedOut
+ *
+ * @brief Fixed capacity output for the binary encoder,
+ * never allocates and remembers if anything did not fit
+ */
+class BinaryFixedOut
+{
+public:
+    BinaryFixedOut(char* data, size_t capacity) noexcept
+        : m_data(data), m_capacity(capacity) {}
+
+    void Append(const void* data, size_t size) noexcept
+    {
+        if (!reserve(size)) return;
+
+        std::memcpy(m_data + m_size, data, size);
+        m_size += size;
+    }
+
+    template<class Format, class... Args>
+    void AppendFormatted(size_t size, const Format& formatString, Args&&... args)
+    {
+        if (!reserve(size)) return;
+
+        fmt::format_to_n(m_data + m_size, size, formatString, std::forward<Args>(args)...);
+        m_size += size;
+    }
+
+    [[nodiscard]] size_t Size() const noexcept { return m_size; }
+    [[nodiscard]] bool Overflowed() const noexcept { return m_overflowed; }
+private:
+    char*  m_data;
+    size_t m_capacity;
+    size_t m_size = 0;
+    bool   m_overflowed = false;
+
+    bool reserve(size_t size) noexcept
+    {
+        if (m_overflowed || m_capacity - m_size < size)
+        {
+            m_overflowed = true;
+            return false;
+        }
+        return true;
+    }
+};
+
+template<class T, class Out>
+void AppendBinaryPod(Out& out, T value)
+{
+    out.Append(&value, sizeof(value));
+}
+
+template<class Out>
+void AppendBinaryString(Out& out, std::string_view string)
+{
+    AppendBinaryPod(out, static_cast<uint32_t>(string.size()));
+    out.Append(string.data(), string.size());
+}
+
+/**
+ * @brief Formats the arguments and encodes the result as one string argument
+ *
+ * @tparam Out BinaryBufferOut or BinaryFixedOut
+ * @tparam Format
+ * @tparam Args
+ *
+ * @param [in] out
+ * @param [in] formatString
+ * @param [in] args
+ */
+template<class Out, class Format, class... Args>
+void EncodeBinaryFormatted(Out& out, const Format& formatString, Args&&... args)
+{
+    size_t size = fmt::formatted_size(formatString, args...);
+
+    AppendBinaryPod(out, BinaryArgType::STRING);
+    AppendBinaryPod(out, static_cast<uint32_t>(size));
+    out.AppendFormatted(size, formatString, std::forward<Args>(args)...);
+}
+
+/**
+ * @brief Tells if EncodeBinaryArg stores a value of the type itself,
+ * a named argument is raw if its value is
+ *
+ * @tparam T
+ */
+template<class T>
+constexpr bool IsRawBinaryArg() noexcept
+{
+    using U = std::remove_cvref_t<T>;
+
+    if constexpr (IS_NAMED_ARG<U>)
+        return IsRawBinaryArg<decltype(std::declval<const U&>().value)>();
+    else
+        return std::is_arithmetic_v<U> || std::is_convertible_v<const U&, std::string_view>
+            || std::is_null_pointer_v<U> || std::is_pointer_v<U>;
+}
+
+template<class T>
+inline constexpr bool IS_RAW_BINARY_ARG = IsRawBinaryArg<T>();
+
+/**
+ * @brief Encodes one argument. Integers, floats, strings and pointers
+ * are stored raw, anything else is formatted with "{}" and stored as a string.
+ * The logger formats the whole message of a call with such an argument
+ * when logging, so only fields are ever stored this way
+ *
+ * @tparam Out BinaryBufferOut or BinaryFixedOut
+ * @tparam T
+ *
+ * @param [in] out
+ * @param [in] value
+ */
+template<class Out, class T>
+void EncodeBinaryArg(Out& out, const T& value)
+{
+    using U = std::decay_t<T>;
+
+    if constexpr (IS_NAMED_ARG<U>)
+    {
+        std::string_view name = value.name;
+
+        AppendBinaryPod(out, BinaryArgType::NAMED);
+        AppendBinaryString(out, name);
+        out.Append("", 1);
+        EncodeBinaryArg(out, value.value);
+    }
+    else if constexpr (std::is_same_v<U, bool>)
+    {
+        AppendBinaryPod(out, BinaryArgType::BOOL);
+        AppendBinaryPod(out, static_cast<uint8_t>(value));
+    }
+    else if constexpr (std::is_same_v<U, char>)
+    {
+        AppendBinaryPod(out, BinaryArgType::CHAR);
+        AppendBinaryPod(out, value);
+    }
+    else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+    {
+        AppendBinaryPod(out, BinaryArgType::INT);
+        AppendBinaryPod(out, static_cast<int64_t>(value));
+    }
+    else if constexpr (std::is_integral_v<U>)
+    {
+        AppendBinaryPod(out, BinaryArgType::UINT);
+        AppendBinaryPod(out, static_cast<uint64_t>(value));
+    }
+    else if constexpr (std::is_floating_point_v<U>)
+    {
+        AppendBinaryPod(out, BinaryArgType::DOUBLE);
+        AppendBinaryPod(out, static_cast<double>(value));
+    }
+    else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+    {
+        AppendBinaryPod(out, BinaryArgType::STRING);
+        AppendBinaryString(out, value ? std::string_view(value) : std::string_view("(null)"));
+    }
+    else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+    {
+        AppendBinaryPod(out, BinaryArgType::STRING);
+        AppendBinaryString(out, std::string_view(value));
+    }
+    else if constexpr (std::is_null_pointer_v<U>)
+    {
+        AppendBinaryPod(out, BinaryArgType::POINTER);
+        AppendBinaryPod(out, uint64_t{0});
+    }
+    else if constexpr (std::is_pointer_v<U>)
+    {
+        AppendBinaryPod(out, BinaryArgType::POINTER);
+        AppendBinaryPod(out, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+    }
+    else
+    {
+        EncodeBinaryFormatted(out, fmt::format_string<const T&>("{}"), value);
+    }
+}
+
+/**
+ * @brief Appends the file header
+ *
+ * @param [in] buffer
+ */
+inline void AppendBinaryFileHeader(fmt::memory_buffer& buffer)
+{
+    BinaryBufferOut out{buffer};
+
+    out.Append(BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC));
+    AppendBinaryPod(out, BINARY_LOG_VERSION);
+    AppendBinaryPod(out, uint32_t{0});
+}
+
+/**
+ * @brief Appends a SITE entry
+ *
+ * @param [in] buffer
+ * @param [in] siteId
+ * @param [in] fileName
+ * @param [in] functionName
+ * @param [in] line
+ * @param [in] format nullptr data if the site has no message
+ */
+inline void AppendBinarySite(fmt::memory_buffer& buffer, uint32_t siteId,
+                             std::string_view fileName, std::string_view functionName,
+                             size_t line, std::string_view format)
+{
+    BinaryBufferOut out{buffer};
+    size_t start = buffer.size();
+
+    AppendBinaryPod(out, uint32_t{0});
+    AppendBinaryPod(out, BinaryEntryKind::SITE);
+    AppendBinaryPod(out, siteId);
+    AppendBinaryPod(out, static_cast<uint32_t>(line));
+    AppendBinaryPod(out, static_cast<uint32_t>(fileName.size()));
+    AppendBinaryPod(out, static_cast<uint32_t>(functionName.size()));
+    AppendBinaryPod(out, static_cast<uint32_t>(format.size()));
+    AppendBinaryPod(out, static_cast<uint8_t>(format.data() != nullptr));
+    out.Append(fileName.data(), fileName.size());
+    out.Append(functionName.data(), functionName.size());
+    out.Append(format.data(), format.size());
+
+    uint32_t size = static_cast<uint32_t>(buffer.size() - start);
+    std::memcpy(buffer.data() + start, &size, sizeof(size));
+}
+
+/**
+ * @brief Appends a RECORD entry header and the arguments
+ *
+ * @param [in] buffer
+ * @param [in] siteId
+ * @param [in] type
+ * @param [in] flags
+ * @param [in] errorCode
+ * @param [in] time ns since epoch
+ * @param [in] argCount
+ * @param [in] args encoded arguments
+ * @param [in] suppressed calls of the site skipped by a rate limit
+ */
+inline void AppendBinaryRecord(fmt::memory_buffer& buffer, uint32_t siteId, uint8_t type,
+                               uint8_t flags, int32_t errorCode, int64_t time,
+                               uint8_t argCount, std::string_view args, uint32_t suppressed = 0)
+{
+    BinaryBufferOut out{buffer};
+
+    size_t size = BINARY_ENTRY_HEADER_SIZE + BINARY_RECORD_HEADER_SIZE + args.size();
+
+    if (suppressed)
+    {
+        flags |= BINARY_RECORD_SUPPRESSED;
+        size  += sizeof(suppressed);
+    }
+
+    AppendBinaryPod(out, static_cast<uint32_t>(size));
+    AppendBinaryPod(out, BinaryEntryKind::RECORD);
+    AppendBinaryPod(out, siteId);
+    AppendBinaryPod(out, type);
+    AppendBinaryPod(out, flags);
+    AppendBinaryPod(out, errorCode);
+    AppendBinaryPod(out, time);
+    AppendBinaryPod(out, argCount);
+
+    if (suppressed)
+        AppendBinaryPod(out, suppressed);
+
+    out.Append(args.data(), args.size());
+}
+
+/**
+ * @brief Decoded SITE entry, strings point into the log
+ */
+struct BinarySiteView
+{
+    uint32_t         siteId = BINARY_INVALID_SITE;
+    uint32_t         line = 0;
+    std::string_view fileName{};
+    std::string_view functionName{};
+    std::string_view format{};
+    bool             hasFormat = false;
+};
+
+/**
+ * @brief Decoded RECORD entry, arguments point into the log
+ */
+struct BinaryRecordView
+{
+    uint32_t         siteId = BINARY_INVALID_SITE;
+    uint8_t          type = 0;
+    uint8_t          flags = 0;
+    int32_t          errorCode = 0;
+    int64_t          time = 0;
+    uint8_t          argCount = 0;
+    uint32_t         suppressed = 0;
+    std::string_view args{};
+};
+
+/**
+ * @class BinaryLogReader
+ *
+ * @brief Walks the entries of a binary log in memory without copying.
+ * A log written through a MappedFileSink whose process died ends with
+ * the zeros of its preallocated space, a tail of only zeros ends the log
+ */
+class BinaryLogReader
+{
+public:
+    /** @enum Entry
+     * @brief What Next() found
+     */
+    enum class Entry
+    {
+        FILE_HEADER, ///< a new log starts, sites seen so far are invalid
+        SITE,        ///< @see Site()
+        RECORD,      ///< @see Record()
+        END,
+        CORRUPTED,
+    };
+
+    BinaryLogReader(const char* data, size_t size) noexcept
+        : m_data(data), m_size(size) {}
+
+    /**
+     * @brief Decodes the next entry
+     *
+     * @return Entry
+     */
+    Entry Next() noexcept
+    {
+        if (m_pos == m_size)
+            return Entry::END;
+
+        if (m_size - m_pos >= BINARY_FILE_HEADER_SIZE &&
+            std::memcmp(m_data + m_pos, BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC)) == 0)
+        {
+            uint32_t version = 0;
+            std::memcpy(&version, m_data + m_pos + sizeof(BINARY_LOG_MAGIC), sizeof(version));
+
+            if (version != BINARY_LOG_VERSION)
+                return Entry::CORRUPTED;
+
+            m_pos += BINARY_FILE_HEADER_SIZE;
+            return Entry::FILE_HEADER;
+        }
+
+        if (isZeroTail())
+        {
+            m_pos = m_size;
+            return Entry::END;
+        }
+
+        uint32_t size = 0;
+        BinaryEntryKind kind{};
+
+        if (m_size - m_pos < BINARY_ENTRY_HEADER_SIZE)
+            return Entry::CORRUPTED;
+
+        std::memcpy(&size, m_data + m_pos, sizeof(size));
+        std::memcpy(&kind, m_data + m_pos + sizeof(size), sizeof(kind));
+
+        if (size < BINARY_ENTRY_HEADER_SIZE || size > m_size - m_pos)
+            return Entry::CORRUPTED;
+
+        std::string_view payload{m_data + m_pos + BINARY_ENTRY_HEADER_SIZE, size - BINARY_ENTRY_HEADER_SIZE};
+        m_pos += size;
+
+        switch (kind)
+        {
+            case BinaryEntryKind::SITE:
+                return decodeSite(payload) ? Entry::SITE : Entry::CORRUPTED;
+            case BinaryEntryKind::RECORD:
+                return decodeRecord(payload) ? Entry::RECORD : Entry::CORRUPTED;
+            default:
+                return Entry::CORRUPTED;
+        }
+    }
+
+    [[nodiscard]] const BinarySiteView& Site() const noexcept { return m_site; }
+    [[nodiscard]] const BinaryRecordView& Record() const noexcept { return m_record; }
+    [[nodiscard]] size_t Position() const noexcept { return m_pos; }
+private:
+    const char*      m_data;
+    size_t           m_size;
+    size_t           m_pos = 0;
+    BinarySiteView   m_site{};
+    BinaryRecordView m_record{};
+
+    /// The scan stops at the first byte that is not zero, usually in the entry size
+    [[nodiscard]] bool isZeroTail() const noexcept
+    {
+        if (m_data[m_pos] != '\0')
+            return false;
+
+        return std::all_of(m_data + m_pos, m_data + m_size, [](char c) { return c == '\0'; });
+    }
+
+    template<class T>
+    static bool read(std::string_view& payload, T& value) noexcept
+    {
+        if (payload.size() < sizeof(value))
+            return false;
+
+        std::memcpy(&value, payload.data(), sizeof(value));
+        payload.remove_prefix(sizeof(value));
+
+        return true;
+    }
+
+    static bool readString(std::string_view& payload, uint32_t size, std::string_view& string) noexcept
+    {
+        if (payload.size() < size)
+            return false;
+
+        string = payload.substr(0, size);
+        payload.remove_prefix(size);
+
+        return true;
+    }
+
+    bool decodeSite(std::string_view payload) noexcept
+    {
+        uint32_t fileSize = 0, functionSize = 0, formatSize = 0;
+        uint8_t hasFormat = 0;
+
+        bool ok = read(payload, m_site.siteId) && read(payload, m_site.line)
+               && read(payload, fileSize) && read(payload, functionSize)
+               && read(payload, formatSize) && read(payload, hasFormat)
+               && readString(payload, fileSize, m_site.fileName)
+               && readString(payload, functionSize, m_site.functionName)
+               && readString(payload, formatSize, m_site.format)
+               && m_site.siteId < BINARY_MAX_SITES;
+
+        m_site.hasFormat = hasFormat != 0;
+
+        return ok;
+    }
+
+    bool decodeRecord(std::string_view payload) noexcept
+    {
+        bool ok = read(payload, m_record.siteId) && read(payload, m_record.type)
+               && read(payload, m_record.flags) && read(payload, m_record.errorCode)
+               && read(payload, m_record.time) && read(payload, m_record.argCount);
+
+        m_record.suppressed = 0;
+        if (ok && (m_record.flags & BINARY_RECORD_SUPPRESSED))
+            ok = read(payload, m_record.suppressed);
+
+        m_record.args = payload;
+
+        return ok;
+    }
+};
+
+/**
+ * @brief Decodes encoded arguments, calls visitor(name, value) for each of them.
+ * The name is nullptr for arguments that are not fields, the value is
+ * bool, char, int64_t, uint64_t, double, fmt::string_view or const void*
+ *
+ * @tparam Visitor
+ *
+ * @param [in] args
+ * @param [in] argCount
+ * @param [in] visitor
+ *
+ * @return true
+ * @return false the arguments are corrupted
+ */
+template<class Visitor>
+bool VisitBinaryArgs(std::string_view args, uint8_t argCount, Visitor&& visitor)
+{
+    auto readPod = [&args](auto& value)
+    {
+        if (args.size() < sizeof(value))
+            return false;
+
+        std::memcpy(&value, args.data(), sizeof(value));
+        args.remove_prefix(sizeof(value));
+
+        return true;
+    };
+
+    for (uint8_t i = 0; i < argCount; i++)
+    {
+        const char* name = nullptr;
+        BinaryArgType tag{};
+
+        if (!readPod(tag)) return false;
+
+        if (tag == BinaryArgType::NAMED)
+        {
+            uint32_t size = 0;
+            if (!readPod(size) || args.size() <= size || args[size] != '\0') return false;
+
+            name = args.data();
+            args.remove_prefix(size + 1);
+
+            if (!readPod(tag) || tag == BinaryArgType::NAMED) return false;
+        }
+
+        switch (tag)
+        {
+            case BinaryArgType::BOOL:
+            {
+                uint8_t value = 0;
+                if (!readPod(value)) return false;
+                visitor(name, value != 0);
+                break;
+            }
+            case BinaryArgType::CHAR:
+            {
+                char value = 0;
+                if (!readPod(value)) return false;
+                visitor(name, value);
+                break;
+            }
+            case BinaryArgType::INT:
+            {
+                int64_t value = 0;
+                if (!readPod(value)) return false;
+                visitor(name, value);
+                break;
+            }
+            case BinaryArgType::UINT:
+            {
+                uint64_t value = 0;
+                if (!readPod(value)) return false;
+                visitor(name, value);
+                break;
+            }
+            case BinaryArgType::DOUBLE:
+            {
+                double value = 0;
+                if (!readPod(value)) return false;
+                visitor(name, value);
+                break;
+            }
+            case BinaryArgType::STRING:
+            {
+                uint32_t size = 0;
+                if (!readPod(size) || args.size() < size) return false;
+                visitor(name, fmt::string_view(args.data(), size));
+                args.remove_prefix(size);
+                break;
+            }
+            case BinaryArgType::POINTER:
+            {
+                uint64_t value = 0;
+                if (!readPod(value)) return false;
+                visitor(name, reinterpret_cast<const void*>(static_cast<uintptr_t>(value)));
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Formats a message from its format string and encoded arguments,
+ * fields are listed after it as " name=value" like in text records
+ *
+ * @param [in] buffer
+ * @param [in] format
+ * @param [in] args
+ * @param [in] argCount
+ *
+ * @return true
+ * @return false the arguments are corrupted or do not match the format,
+ * an explanation is appended instead
+ */
+inline bool RenderBinaryMessage(fmt::memory_buffer& buffer, std::string_view format,
+                                std::string_view args, uint8_t argCount)
+{
+    fmt::dynamic_format_arg_store<fmt::format_context> store;
+    store.reserve(argCount, argCount);
+
+    bool hasFields = false;
+
+    bool decoded = VisitBinaryArgs(args, argCount, [&](const char* name, auto value)
+    {
+        if (name)
+        {
+            store.push_back(fmt::arg(name, value));
+            hasFields = true;
+        }
+        else
+        {
+            store.push_back(value);
+        }
+    });
+
+    if (!decoded)
+        return false;
+
+    size_t start = buffer.size();
+
+    try
+    {
+        fmt::vformat_to(std::back_inserter(buffer), fmt::string_view(format.data(), format.size()), store);
+    }
+    catch (const std::exception& e)
+    {
+        buffer.resize(start);
+        fmt::format_to(std::back_inserter(buffer), "<format error: {}>", e.what());
+        return false;
+    }
+
+    if (hasFields)
+    {
+        VisitBinaryArgs(args, argCount, [&buffer](const char* name, auto value)
+        {
+            if (name)
+                fmt::format_to(std::back_inserter(buffer), " {}={}", name, value);
+        });
+    }
+
+    return true;
+}
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_BINARY_FORMAT_HPP
+
+// NOLINTEND
@@ -0,0 +1,195 @@
+/**
+ * @file BoundedQueue.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Bounded lock-free multi-producer queue
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_BOUNDED_QUEUE_HPP
+#define MLIB_LOGGER_BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace mlib {
+namespace detail {
+
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * @class BoundedQueue
+ *
+ * @brief Bounded lock-free queue of preallocated cells (Vyukov's algorithm).
+ *
+ * Any number of threads may push. Popping is lock-free as well,
+ * so the queue stays correct if a producer discards the oldest cell.
+ * Cells are filled and consumed in place, nothing is copied
+ * or allocated after construction.
+ *
+ * @tparam T cell payload, must be default constructible
+ */
+template<class T>
+class BoundedQueue
+{
+public:
+    /**
+     * @brief Construct a queue
+     *
+     * @param [in] capacity rounded up to a power of two
+     */
+    explicit BoundedQueue(size_t capacity)
+        : m_mask(roundUpToPowerOfTwo(capacity) - 1),
+          m_cells(new Cell[m_mask + 1])
+    {
+        for (size_t i = 0; i <= m_mask; i++)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue& other) = delete;
+    BoundedQueue(BoundedQueue&& other) = delete;
+    BoundedQueue& operator=(const BoundedQueue& other) = delete;
+    BoundedQueue& operator=(BoundedQueue&& other) = delete;
+
+    /**
+     * @brief Claims a cell, calls fill(T&) on it and publishes it
+     *
+     * @tparam Fill must not throw, the cell is already claimed
+     *
+     * @param [in] fill
+     *
+     * @return true pushed
+     * @return false queue is full
+     */
+    template<class Fill>
+    bool TryPush(Fill&& fill) noexcept
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+
+        for (;;)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        fill(cell->data);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @brief Takes the oldest cell, calls consume(T&) on it and frees it
+     *
+     * @tparam Consume
+     *
+     * @param [in] consume
+     *
+     * @return true popped
+     * @return false queue is empty
+     */
+    template<class Consume>
+    bool TryPop(Consume&& consume)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+
+        for (;;)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0)
+            {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        consume(cell->data);
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @brief Number of cells ever claimed by producers
+     */
+    [[nodiscard]] size_t PushedCount() const noexcept
+    {
+        return m_enqueuePos.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Approximate number of cells waiting to be popped
+     */
+    [[nodiscard]] size_t Size() const noexcept
+    {
+        size_t enqueue = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeue = m_dequeuePos.load(std::memory_order_relaxed);
+
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+    [[nodiscard]] size_t Capacity() const noexcept { return m_mask + 1; }
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{0};
+        T data{};
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t value) noexcept
+    {
+        size_t result = 2;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_enqueuePos{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_dequeuePos{0};
+};
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_BOUNDED_QUEUE_HPP
+
+// NOLINTEND
@@ -15,6 +15,8 @@
 #define MLIB_LOGGER_CONSOLE_COLOR_HPP
 
 #include <cstdio>
+#include <cstdlib>
+#include <string_view>
 
 #ifdef __linux
 #include <unistd.h>
@@ -24,7 +26,7 @@ namespace mlib {
 namespace detail {
 
 /** @enum ConsoleColor
- * @brief Represents colors for @see SetConsoleColor
+ * @brief Represents colors for @see GetConsoleColorSequence
  */
 enum class ConsoleColor
 {
@@ -38,8 +40,18 @@ enum class ConsoleColor
     WHITE,
 };
 
+/** @enum ColorMode
+ * @brief When records written to a stream are colored
+ */
+enum class ColorMode
+{
+    AUTO,   ///< if the stream is a terminal and NO_COLOR is not set
+    ALWAYS,
+    NEVER,
+};
+
 /**
- * @brief Checks if file supports colors
+ * @brief Checks if file supports colors, a syscall, so the result is meant to be cached
  *
  * @param [in] file
  *
@@ -49,21 +61,65 @@ enum class ConsoleColor
 static inline bool SupportsColors(FILE* file) noexcept
 {
 #ifdef __linux
-    return isatty(fileno(file));
-#endif
+    return file && isatty(fileno(file));
+#else
     return false;
+#endif
 }
 
 /**
- * @brief Set the console color
+ * @brief Checks the NO_COLOR environment variable, see no-color.org
+ *
+ * @return true it is set and not empty
+ * @return false
+ */
+static inline bool ColorsDisabledByEnvironment() noexcept
+{
+    const char* noColor = std::getenv("NO_COLOR");
+
+    return noColor && *noColor;
+}
+
+/**
+ * @brief Decides once if records written to the file are colored
+ *
+ * @param [in] file
+ * @param [in] mode
+ *
+ * @return true
+ * @return false
+ */
+static inline bool ResolveColors(FILE* file, ColorMode mode) noexcept
+{
+    switch (mode)
+    {
+        case ColorMode::ALWAYS: return true;
+        case ColorMode::NEVER:  return false;
+        default:                return !ColorsDisabledByEnvironment() && SupportsColors(file);
+    }
+}
+
+/**
+ * @brief Returns the escape sequence that sets the color
  *
- * @param [in] out stream
  * @param [in] color
+ *
+ * @return std::string_view escape sequence
  */
-static inline void SetConsoleColor(FILE* file, ConsoleColor color)
+static constexpr std::string_view GetConsoleColorSequence(ConsoleColor color) noexcept
 {
-    if (SupportsColors(file))
-        fprintf(file, "\033[0;%dm", static_cast<int>(color));
+    switch (color)
+    {
+        case ConsoleColor::BLACK:   return "\033[0;30m";
+        case ConsoleColor::RED:     return "\033[0;31m";
+        case ConsoleColor::GREEN:   return "\033[0;32m";
+        case ConsoleColor::YELLOW:  return "\033[0;33m";
+        case ConsoleColor::BLUE:    return "\033[0;34m";
+        case ConsoleColor::MAGENTA: return "\033[0;35m";
+        case ConsoleColor::CYAN:    return "\033[0;36m";
+        case ConsoleColor::WHITE:   return "\033[0;37m";
+        default:                    return "";
+    }
 }
 
 } // namespace detail
@@ -15,8 +15,13 @@
 #ifndef MLIB_LOGGER_FILE_HPP
 #define MLIB_LOGGER_FILE_HPP
 
+#include <cerrno>
 #include <cstdio>
 
+#ifdef __linux
+#include <unistd.h>
+#endif
+
 namespace mlib {
 class Logger;
 
@@ -41,6 +46,51 @@ public:
         fflush(m_file);
     }
 
+    /**
+     * @brief Waits until the written data is on the disk.
+     * On linux it is fdatasync(2), elsewhere only the stream is flushed
+     */
+    void Sync() noexcept
+    {
+#ifdef __linux
+        ::fdatasync(fileno(m_file));
+#else
+        fflush(m_file);
+#endif
+    }
+
+    /**
+     * @brief Writes the bytes with as few syscalls as possible.
+     * On linux the data goes straight to the descriptor
+     * so one call is one write(2), the stream must be unbuffered
+     *
+     * @param [in] data
+     * @param [in] size
+     */
+    void Write(const char* data, size_t size) noexcept
+    {
+#ifdef __linux
+        int fd = fileno(m_file);
+
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, data, size);
+
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+#else
+        fwrite(data, 1, size, m_file);
+#endif
+    }
+
     virtual ~File()
     {
         if (m_file && m_file != stdout && m_file != stderr && m_file != stdin)
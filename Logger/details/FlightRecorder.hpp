@@ -0,0 +1,340 @@
+/**
+ * @file FlightRecorder.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief In-memory ring of recent records dumped on a fatal signal
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_FLIGHT_RECORDER_HPP
+#define MLIB_LOGGER_FLIGHT_RECORDER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <thread>
+
+#ifdef __linux
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @class FlightRecorder
+ *
+ * @brief Keeps the last bytes of text or JSON records in a preallocated ring.
+ *
+ * Write is called by one thread at a time, Dump may run concurrently
+ * from a signal handler and only uses async-signal-safe calls.
+ * The start offsets of records are kept beside the ring, one slot per
+ * MIN_RECORD_SIZE bytes of capacity, so every record of the logger, which is
+ * longer, still in the ring has its offset. A dump of a wrapped ring starts
+ * at the first whole record whatever the format.
+ */
+class FlightRecorder
+{
+public:
+    static constexpr size_t PATH_CAPACITY     = 4096;
+    /// Shortest record the logger writes, a text header alone is longer
+    static constexpr size_t MIN_RECORD_SIZE   = 32;
+
+    /**
+     * @brief Construct a recorder
+     *
+     * @param [in] capacity in bytes
+     * @param [in] dumpPath file the ring is written to on a fatal signal
+     */
+    FlightRecorder(size_t capacity, const char* dumpPath)
+        : m_capacity(std::max<size_t>(capacity, 1)), m_ring(new char[m_capacity]),
+          m_boundaryCount(std::max<size_t>(m_capacity / MIN_RECORD_SIZE, 1)),
+          m_boundaries(new std::atomic<size_t>[m_boundaryCount]())
+    {
+        size_t pathSize = std::min(std::strlen(dumpPath), PATH_CAPACITY - 1);
+
+        std::memcpy(m_dumpPath, dumpPath, pathSize);
+        m_dumpPath[pathSize] = '\0';
+    }
+
+    FlightRecorder(const FlightRecorder& other) = delete;
+    FlightRecorder& operator=(const FlightRecorder& other) = delete;
+
+    /**
+     * @brief Appends a record, overwriting the oldest bytes
+     *
+     * @param [in] record
+     */
+    void Write(std::string_view record) noexcept
+    {
+        if (record.size() > m_capacity)
+            record.remove_prefix(record.size() - m_capacity);
+
+        size_t written = m_written.load(std::memory_order_relaxed);
+        size_t position = written % m_capacity;
+        size_t first = std::min(record.size(), m_capacity - position);
+
+        std::memcpy(m_ring.get() + position, record.data(), first);
+        std::memcpy(m_ring.get(), record.data() + first, record.size() - first);
+
+        m_boundaries[m_records++ % m_boundaryCount].store(written, std::memory_order_relaxed);
+        m_written.store(written + record.size(), std::memory_order_release);
+    }
+
+#ifdef __linux
+    /**
+     * @brief Writes the ring to the dump file, oldest record first.
+     * Async-signal-safe
+     */
+    void Dump() const noexcept
+    {
+        int fd = ::open(m_dumpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return;
+
+        size_t written = m_written.load(std::memory_order_acquire);
+
+        if (written <= m_capacity)
+        {
+            writeAll(fd, m_ring.get(), written);
+            ::close(fd);
+            return;
+        }
+
+        size_t start = written % m_capacity;
+        size_t skipped = skipPartialRecord(written);
+
+        for (size_t left = m_capacity - skipped, position = (start + skipped) % m_capacity; left > 0;)
+        {
+            size_t chunk = std::min(left, m_capacity - position);
+
+            writeAll(fd, m_ring.get() + position, chunk);
+
+            position = (position + chunk) % m_capacity;
+            left -= chunk;
+        }
+
+        ::close(fd);
+    }
+#endif
+private:
+    const size_t            m_capacity;
+    std::unique_ptr<char[]> m_ring;
+    std::atomic<size_t>     m_written{0};
+    const size_t            m_boundaryCount;
+    /// Offsets in the written bytes where records start
+    std::unique_ptr<std::atomic<size_t>[]> m_boundaries;
+    size_t                  m_records = 0;
+    char                    m_dumpPath[PATH_CAPACITY] = {};
+
+    /// Bytes before the oldest record start still in the ring,
+    /// none are skipped if the ring holds no record start
+    size_t skipPartialRecord(size_t written) const noexcept
+    {
+        size_t oldest = written - m_capacity;
+        size_t first = written;
+
+        for (size_t i = 0; i < m_boundaryCount; i++)
+        {
+            size_t offset = m_boundaries[i].load(std::memory_order_relaxed);
+
+            if (offset >= oldest && offset < first)
+                first = offset;
+        }
+
+        return first == written ? 0 : first - oldest;
+    }
+
+#ifdef __linux
+    static void writeAll(int fd, const char* data, size_t size) noexcept
+    {
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, data, size);
+
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+#endif
+};
+
+#ifdef __linux
+
+inline constexpr size_t MAX_FLIGHT_RECORDERS = 16;
+inline constexpr size_t SIGNAL_STACK_SIZE    = 64 << 10;
+inline constexpr int    FATAL_SIGNALS[] = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+
+inline std::atomic<FlightRecorder*> flightRecorders[MAX_FLIGHT_RECORDERS] = {};
+/// Handlers between taking a recorder from a slot and finishing its dump
+inline std::atomic<int>             activeFlightDumps{0};
+inline struct sigaction             previousFatalActions[std::size(FATAL_SIGNALS)] = {};
+
+inline void flightRecorderSignalHandler(int signal) noexcept
+{
+    int savedErrno = errno;
+
+    // Counted before the slots are read, so an unregistering thread that
+    // cleared a slot and then sees no active dump knows the recorder is unused
+    activeFlightDumps.fetch_add(1, std::memory_order_seq_cst);
+
+    for (std::atomic<FlightRecorder*>& slot : flightRecorders)
+    {
+        if (FlightRecorder* recorder = slot.load(std::memory_order_seq_cst))
+            recorder->Dump();
+    }
+
+    activeFlightDumps.fetch_sub(1, std::memory_order_release);
+
+    errno = savedErrno;
+
+    for (size_t i = 0; i < std::size(FATAL_SIGNALS); i++)
+    {
+        if (FATAL_SIGNALS[i] == signal)
+            sigaction(signal, &previousFatalActions[i], nullptr);
+    }
+
+    raise(signal);
+}
+
+/**
+ * @class SignalStack
+ *
+ * @brief Alternate signal stack of the calling thread, so a stack overflow
+ * can still be dumped. It is removed before the thread frees it
+ */
+class SignalStack
+{
+public:
+    /**
+     * @brief Installs a stack for the calling thread unless it has one
+     */
+    static void Install() noexcept
+    {
+        thread_local SignalStack stack{};
+    }
+
+    SignalStack(const SignalStack& other) = delete;
+    SignalStack& operator=(const SignalStack& other) = delete;
+
+    ~SignalStack()
+    {
+        if (!m_memory) return;
+
+        stack_t disabled{};
+        disabled.ss_flags = SS_DISABLE;
+        sigaltstack(&disabled, nullptr);
+    }
+private:
+    std::unique_ptr<char[]> m_memory{};
+
+    SignalStack() noexcept
+    {
+        stack_t current{};
+
+        if (sigaltstack(nullptr, &current) != 0 || !(current.ss_flags & SS_DISABLE)) return;
+
+        m_memory.reset(new (std::nothrow) char[SIGNAL_STACK_SIZE]);
+        if (!m_memory) return;
+
+        stack_t stack{};
+        stack.ss_sp   = m_memory.get();
+        stack.ss_size = SIGNAL_STACK_SIZE;
+
+        if (sigaltstack(&stack, nullptr) != 0)
+            m_memory.reset();
+    }
+};
+
+/**
+ * @brief Dumps the recorder when the process gets a fatal signal.
+ * The handler is installed on the first call, the previous handler
+ * is restored and the signal is raised again after dumping.
+ * The calling thread gets an alternate signal stack if it has none,
+ * a stack overflow on another thread is dumped only if that thread has one
+ *
+ * @param [in] recorder
+ *
+ * @return true registered
+ * @return false too many recorders
+ */
+inline bool RegisterFlightRecorder(FlightRecorder* recorder) noexcept
+{
+    static std::once_flag installed{};
+
+    std::call_once(installed, []
+    {
+        struct sigaction action{};
+        action.sa_handler = flightRecorderSignalHandler;
+        action.sa_flags   = SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+
+        for (size_t i = 0; i < std::size(FATAL_SIGNALS); i++)
+            sigaction(FATAL_SIGNALS[i], &action, &previousFatalActions[i]);
+    });
+
+    SignalStack::Install();
+
+    for (std::atomic<FlightRecorder*>& slot : flightRecorders)
+    {
+        FlightRecorder* expected = nullptr;
+
+        if (slot.compare_exchange_strong(expected, recorder, std::memory_order_acq_rel))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Stops dumping the recorder on fatal signals. Returns after
+ * every handler that may have seen it is done, the recorder may be freed then
+ *
+ * @param [in] recorder
+ */
+inline void UnregisterFlightRecorder(FlightRecorder* recorder) noexcept
+{
+    for (std::atomic<FlightRecorder*>& slot : flightRecorders)
+    {
+        FlightRecorder* expected = recorder;
+        slot.compare_exchange_strong(expected, nullptr, std::memory_order_seq_cst);
+    }
+
+    while (activeFlightDumps.load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+}
+
+#else
+
+inline bool RegisterFlightRecorder(FlightRecorder*) noexcept { return false; }
+inline void UnregisterFlightRecorder(FlightRecorder*) noexcept {}
+
+#endif
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_FLIGHT_RECORDER_HPP
+
+// NOLINTEND
@@ -0,0 +1,46 @@
+/**
+ * @file FmtTraits.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief fmt type traits the logger depends on
+ *
+ * fmt keeps these traits in fmt::detail, which is not part of its API
+ * and changes between versions. They are used only through this header,
+ * so a new fmt version is adapted to here.
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_FMT_TRAITS_HPP
+#define MLIB_LOGGER_FMT_TRAITS_HPP
+
+#include <type_traits>
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @brief Tells if a format string was made with FMT_COMPILE
+ */
+template<class T>
+inline constexpr bool IS_COMPILED_FORMAT = fmt::detail::is_compiled_string<std::remove_cvref_t<T>>::value;
+
+/**
+ * @brief Tells if an argument is a fmt named argument, made with fmt::arg or _a
+ */
+template<class T>
+inline constexpr bool IS_NAMED_ARG = fmt::detail::is_named_arg<std::remove_cvref_t<T>>::value;
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_FMT_TRAITS_HPP
+
+// NOLINTEND
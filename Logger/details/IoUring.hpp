@@ -0,0 +1,342 @@
+/**
+ * @file IoUring.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Minimal io_uring wrapper over raw syscalls, no liburing needed
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_IO_URING_HPP
+#define MLIB_LOGGER_IO_URING_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__linux) && __has_include(<linux/io_uring.h>)
+#define MLIB_LOGGER_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @struct IoCompletion
+ *
+ * @brief Result of one finished request
+ */
+struct IoCompletion
+{
+    uint64_t userData = 0;
+    int32_t  result = 0; ///< bytes written or -errno
+};
+
+#ifdef MLIB_LOGGER_HAS_IO_URING
+
+/**
+ * @class IoUring
+ *
+ * @brief A ring of write requests.
+ *
+ * Requests are queued and submitted by one thread at a time,
+ * completions are reaped by one other thread. The rings are shared
+ * with the kernel, their indices are published with acquire/release.
+ * If the kernel has no io_uring the object is not open.
+ */
+class IoUring
+{
+public:
+    /**
+     * @brief Sets up a ring
+     *
+     * @param [in] entries submission queue size
+     */
+    explicit IoUring(unsigned entries) noexcept
+    {
+        io_uring_params params{};
+
+        m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) return;
+
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !mapRings(params))
+        {
+            unmapRings();
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    ~IoUring()
+    {
+        if (m_fd < 0) return;
+
+        unmapRings();
+        ::close(m_fd);
+    }
+
+    IoUring(const IoUring& other) = delete;
+    IoUring& operator=(const IoUring& other) = delete;
+
+    /**
+     * @brief Tells if the ring is set up
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] bool IsOpen() const noexcept { return m_fd >= 0; }
+
+    /**
+     * @brief Pins buffers in the kernel, writes from them skip
+     * mapping the pages on every request
+     *
+     * @param [in] buffers
+     * @param [in] count
+     *
+     * @return true
+     * @return false the kernel refused, e.g. RLIMIT_MEMLOCK is too low
+     */
+    bool RegisterBuffers(const iovec* buffers, unsigned count) noexcept
+    {
+        return ::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+    }
+
+    /**
+     * @brief Queues a write at an offset
+     *
+     * @param [in] fd
+     * @param [in] data
+     * @param [in] size
+     * @param [in] offset
+     * @param [in] bufferIndex registered buffer the data is in, -1 if it is not registered
+     * @param [in] userData returned with the completion
+     *
+     * @return true
+     * @return false the submission queue is full
+     */
+    bool PrepareWrite(int fd, const char* data, uint32_t size, uint64_t offset,
+                      int bufferIndex, uint64_t userData) noexcept
+    {
+        io_uring_sqe* sqe = nextEntry();
+        if (!sqe) return false;
+
+        sqe->opcode    = bufferIndex >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd        = fd;
+        sqe->off       = offset;
+        sqe->addr      = reinterpret_cast<uintptr_t>(data);
+        sqe->len       = size;
+        sqe->buf_index = static_cast<uint16_t>(bufferIndex >= 0 ? bufferIndex : 0);
+        sqe->user_data = userData;
+
+        publishEntry();
+        return true;
+    }
+
+    /**
+     * @brief Queues a request that does nothing, used to wake the reaper
+     *
+     * @param [in] userData
+     *
+     * @return true
+     * @return false the submission queue is full
+     */
+    bool PrepareNop(uint64_t userData) noexcept
+    {
+        io_uring_sqe* sqe = nextEntry();
+        if (!sqe) return false;
+
+        sqe->opcode    = IORING_OP_NOP;
+        sqe->fd        = -1;
+        sqe->user_data = userData;
+
+        publishEntry();
+        return true;
+    }
+
+    /**
+     * @brief Hands queued requests to the kernel, does not wait for them
+     *
+     * @return true
+     * @return false the kernel refused, the requests stay queued
+     */
+    bool Submit() noexcept
+    {
+        while (m_queued > 0)
+        {
+            long submitted = ::syscall(__NR_io_uring_enter, m_fd, m_queued, 0, 0, nullptr, 0);
+
+            if (submitted < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+
+            m_queued -= static_cast<unsigned>(submitted);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Takes back the queued requests the kernel has not accepted,
+     * after a failed Submit they would otherwise wait for the next one
+     */
+    void DropQueued() noexcept
+    {
+        std::atomic_ref(*m_sqTail).store(*m_sqTail - m_queued, std::memory_order_release);
+        m_queued = 0;
+    }
+
+    /**
+     * @brief Waits for a request to finish
+     *
+     * @param [out] completion
+     *
+     * @return true
+     * @return false waiting failed
+     */
+    bool WaitCompletion(IoCompletion& completion) noexcept
+    {
+        for (;;)
+        {
+            unsigned head = *m_cqHead;
+
+            if (head != std::atomic_ref(*m_cqTail).load(std::memory_order_acquire))
+            {
+                const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+
+                completion.userData = cqe.user_data;
+                completion.result   = cqe.res;
+
+                std::atomic_ref(*m_cqHead).store(head + 1, std::memory_order_release);
+                return true;
+            }
+
+            if (::syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR)
+                return false;
+        }
+    }
+private:
+    int           m_fd = -1;
+    unsigned      m_queued = 0;
+
+    void*         m_rings = MAP_FAILED;
+    size_t        m_ringsSize = 0;
+    io_uring_sqe* m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t        m_sqesSize = 0;
+
+    unsigned*     m_sqHead = nullptr;
+    unsigned*     m_sqTail = nullptr;
+    unsigned*     m_sqMask = nullptr;
+    unsigned*     m_sqEntries = nullptr;
+    unsigned*     m_sqArray = nullptr;
+
+    unsigned*     m_cqHead = nullptr;
+    unsigned*     m_cqTail = nullptr;
+    unsigned*     m_cqMask = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+
+    bool mapRings(const io_uring_params& params) noexcept
+    {
+        size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        m_ringsSize = sqSize > cqSize ? sqSize : cqSize;
+        m_rings = ::mmap(nullptr, m_ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_fd, IORING_OFF_SQ_RING);
+        if (m_rings == MAP_FAILED) return false;
+
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+
+        char* rings = static_cast<char*>(m_rings);
+
+        m_sqes      = static_cast<io_uring_sqe*>(sqes);
+        m_sqHead    = reinterpret_cast<unsigned*>(rings + params.sq_off.head);
+        m_sqTail    = reinterpret_cast<unsigned*>(rings + params.sq_off.tail);
+        m_sqMask    = reinterpret_cast<unsigned*>(rings + params.sq_off.ring_mask);
+        m_sqEntries = reinterpret_cast<unsigned*>(rings + params.sq_off.ring_entries);
+        m_sqArray   = reinterpret_cast<unsigned*>(rings + params.sq_off.array);
+        m_cqHead    = reinterpret_cast<unsigned*>(rings + params.cq_off.head);
+        m_cqTail    = reinterpret_cast<unsigned*>(rings + params.cq_off.tail);
+        m_cqMask    = reinterpret_cast<unsigned*>(rings + params.cq_off.ring_mask);
+        m_cqes      = reinterpret_cast<io_uring_cqe*>(rings + params.cq_off.cqes);
+
+        return true;
+    }
+
+    void unmapRings() noexcept
+    {
+        if (m_sqes != MAP_FAILED)
+            ::munmap(m_sqes, m_sqesSize);
+        if (m_rings != MAP_FAILED)
+            ::munmap(m_rings, m_ringsSize);
+    }
+
+    io_uring_sqe* nextEntry() noexcept
+    {
+        unsigned tail = *m_sqTail;
+
+        if (tail - std::atomic_ref(*m_sqHead).load(std::memory_order_acquire) >= *m_sqEntries)
+            return nullptr;
+
+        io_uring_sqe* sqe = &m_sqes[tail & *m_sqMask];
+        *sqe = io_uring_sqe{};
+
+        return sqe;
+    }
+
+    void publishEntry() noexcept
+    {
+        unsigned tail = *m_sqTail;
+
+        m_sqArray[tail & *m_sqMask] = tail & *m_sqMask;
+        std::atomic_ref(*m_sqTail).store(tail + 1, std::memory_order_release);
+
+        m_queued++;
+    }
+};
+
+#else
+
+struct iovec;
+
+/// No io_uring on this platform, the ring is never open
+class IoUring
+{
+public:
+    explicit IoUring(unsigned) noexcept {}
+
+    [[nodiscard]] bool IsOpen() const noexcept { return false; }
+
+    bool RegisterBuffers(const iovec*, unsigned) noexcept { return false; }
+    bool PrepareWrite(int, const char*, uint32_t, uint64_t, int, uint64_t) noexcept { return false; }
+    bool PrepareNop(uint64_t) noexcept { return false; }
+    bool Submit() noexcept { return false; }
+    void DropQueued() noexcept {}
+    bool WaitCompletion(IoCompletion&) noexcept { return false; }
+};
+
+#endif
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_IO_URING_HPP
+
+// NOLINTEND
@@ -0,0 +1,211 @@
+/**
+ * @file JsonFormat.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief JSON Lines serialization of records and their fields
+ *
+ * Values are written straight into the output buffer,
+ * there is no intermediate document and no allocation per field.
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_JSON_FORMAT_HPP
+#define MLIB_LOGGER_JSON_FORMAT_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <fmt/format.h>
+#include "FmtTraits.hpp"
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @brief Tells if an argument is a field, a fmt named argument
+ */
+template<class T>
+inline constexpr bool IS_FIELD = IS_NAMED_ARG<T>;
+
+/**
+ * @class JsonEscapeIterator
+ *
+ * @brief Output iterator that escapes characters for a JSON string
+ *
+ * @tparam Buffer
+ */
+template<class Buffer>
+class JsonEscapeIterator
+{
+public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type        = void;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = void;
+    using reference         = void;
+
+    explicit JsonEscapeIterator(Buffer& buffer) noexcept
+        : m_buffer(&buffer) {}
+
+    JsonEscapeIterator& operator=(char c)
+    {
+        static constexpr char HEX[] = "0123456789abcdef";
+
+        switch (c)
+        {
+            case '"':  append("\\\""); break;
+            case '\\': append("\\\\"); break;
+            case '\n': append("\\n");  break;
+            case '\r': append("\\r");  break;
+            case '\t': append("\\t");  break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    append("\\u00");
+                    m_buffer->push_back(HEX[(c >> 4) & 0xF]);
+                    m_buffer->push_back(HEX[c & 0xF]);
+                }
+                else
+                {
+                    m_buffer->push_back(c);
+                }
+                break;
+        }
+
+        return *this;
+    }
+
+    JsonEscapeIterator& operator*() noexcept { return *this; }
+    JsonEscapeIterator& operator++() noexcept { return *this; }
+    JsonEscapeIterator  operator++(int) noexcept { return *this; }
+private:
+    Buffer* m_buffer;
+
+    void append(std::string_view string)
+    {
+        m_buffer->append(string.data(), string.data() + string.size());
+    }
+};
+
+/**
+ * @brief Appends a quoted and escaped JSON string
+ *
+ * @param [in] buffer
+ * @param [in] string
+ */
+template<class Buffer>
+void AppendJsonString(Buffer& buffer, std::string_view string)
+{
+    buffer.push_back('"');
+    std::copy(string.begin(), string.end(), JsonEscapeIterator<Buffer>{buffer});
+    buffer.push_back('"');
+}
+
+/**
+ * @brief Appends a value as JSON. Numbers and booleans stay as they are,
+ * anything else becomes a string, formatted with fmt if needed
+ *
+ * @param [in] buffer
+ * @param [in] value
+ */
+template<class Buffer, class T>
+void AppendJsonValue(Buffer& buffer, const T& value)
+{
+    using U = std::decay_t<T>;
+
+    if constexpr (std::is_same_v<U, bool>)
+    {
+        std::string_view string = value ? "true" : "false";
+        buffer.append(string.data(), string.data() + string.size());
+    }
+    else if constexpr (std::is_same_v<U, char>)
+    {
+        AppendJsonString(buffer, std::string_view(&value, 1));
+    }
+    else if constexpr (std::is_integral_v<U>)
+    {
+        fmt::format_to(std::back_inserter(buffer), "{}", value);
+    }
+    else if constexpr (std::is_floating_point_v<U>)
+    {
+        if (std::isfinite(value))
+            fmt::format_to(std::back_inserter(buffer), "{}", value);
+        else
+            buffer.append("null", "null" + 4);
+    }
+    else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+    {
+        if (value)
+            AppendJsonString(buffer, value);
+        else
+            buffer.append("null", "null" + 4);
+    }
+    else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+    {
+        AppendJsonString(buffer, std::string_view(value));
+    }
+    else
+    {
+        buffer.push_back('"');
+        fmt::format_to(JsonEscapeIterator<Buffer>{buffer}, "{}", value);
+        buffer.push_back('"');
+    }
+}
+
+/**
+ * @brief Appends ,"name":value for every field among the arguments.
+ * The logger puts them in a "fields" object, apart from the keys of the record
+ *
+ * @param [in] buffer
+ * @param [in] args
+ */
+template<class Buffer, class... Args>
+void AppendJsonFields(Buffer& buffer, const Args&... args)
+{
+    [[maybe_unused]] auto appendField = [&buffer](const auto& arg)
+    {
+        if constexpr (IS_FIELD<decltype(arg)>)
+        {
+            buffer.push_back(',');
+            AppendJsonString(buffer, arg.name);
+            buffer.push_back(':');
+            AppendJsonValue(buffer, arg.value);
+        }
+    };
+
+    (appendField(args), ...);
+}
+
+/**
+ * @brief Appends " name=value" for every field among the arguments
+ *
+ * @param [in] buffer
+ * @param [in] args
+ */
+template<class Buffer, class... Args>
+void AppendTextFields(Buffer& buffer, const Args&... args)
+{
+    [[maybe_unused]] auto appendField = [&buffer](const auto& arg)
+    {
+        if constexpr (IS_FIELD<decltype(arg)>)
+            fmt::format_to(std::back_inserter(buffer), " {}={}", arg.name, arg.value);
+    };
+
+    (appendField(args), ...);
+}
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_JSON_FORMAT_HPP
+
+// NOLINTEND
@@ -0,0 +1,216 @@
+/**
+ * @file LogContext.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Key-value pairs a thread attaches to every record it logs
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_LOG_CONTEXT_HPP
+#define MLIB_LOGGER_LOG_CONTEXT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include <fmt/format.h>
+
+#ifdef __linux
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "BinaryFormat.hpp"
+#include "JsonFormat.hpp"
+
+namespace mlib {
+namespace detail {
+
+inline constexpr size_t CONTEXT_CAPACITY       = 8;
+inline constexpr size_t CONTEXT_VALUE_CAPACITY = 64;
+
+/// Name of the thread id field
+inline constexpr const char* THREAD_ID_KEY = "thread";
+
+/**
+ * @class LogContext
+ *
+ * @brief A stack of key-value pairs in preallocated storage.
+ *
+ * Values are formatted once, when they are pushed, into fixed-size slots
+ * and truncated to CONTEXT_VALUE_CAPACITY. Pushes beyond CONTEXT_CAPACITY
+ * are ignored. Nothing is allocated. Keys must be static strings.
+ */
+class LogContext
+{
+public:
+    struct Entry
+    {
+        const char* key = nullptr;
+        size_t      size = 0;
+        char        value[CONTEXT_VALUE_CAPACITY];
+
+        [[nodiscard]] std::string_view Value() const noexcept { return {value, size}; }
+    };
+
+    /**
+     * @brief Pushes a pair
+     *
+     * @tparam T anything fmt can format
+     *
+     * @param [in] key static string
+     * @param [in] value
+     *
+     * @return true
+     * @return false the stack is full
+     */
+    template<class T>
+    bool Push(const char* key, const T& value) noexcept
+    {
+        static constexpr std::string_view FORMAT_ERROR = "<format error>";
+
+        if (m_size == CONTEXT_CAPACITY) return false;
+
+        Entry& entry = m_entries[m_size];
+        entry.key = key;
+
+        try
+        {
+            auto result = fmt::format_to_n(entry.value, CONTEXT_VALUE_CAPACITY, "{}", value);
+            entry.size = std::min(result.size, CONTEXT_VALUE_CAPACITY);
+        }
+        catch (...)
+        {
+            entry.size = FORMAT_ERROR.size();
+            std::copy(FORMAT_ERROR.begin(), FORMAT_ERROR.end(), entry.value);
+        }
+
+        m_size++;
+        return true;
+    }
+
+    /**
+     * @brief Pops the last pair
+     */
+    void Pop() noexcept
+    {
+        if (m_size) m_size--;
+    }
+
+    [[nodiscard]] size_t Size() const noexcept { return m_size; }
+
+    [[nodiscard]] const Entry* begin() const noexcept { return m_entries; }
+    [[nodiscard]] const Entry* end() const noexcept { return m_entries + m_size; }
+private:
+    Entry  m_entries[CONTEXT_CAPACITY];
+    size_t m_size = 0;
+};
+
+/**
+ * @brief Returns the context of the calling thread
+ *
+ * @return LogContext&
+ */
+inline LogContext& GetThreadContext() noexcept
+{
+    thread_local LogContext context{};
+
+    return context;
+}
+
+/**
+ * @brief Returns the id of the calling thread, the kernel one on Linux.
+ * Asked once per thread
+ *
+ * @return uint64_t
+ */
+inline uint64_t GetThreadId() noexcept
+{
+#ifdef __linux
+    thread_local const uint64_t id = static_cast<uint64_t>(::syscall(SYS_gettid));
+#else
+    thread_local const uint64_t id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+#endif
+
+    return id;
+}
+
+/**
+ * @brief Appends " key=value" for every pair of the context
+ *
+ * @param [in] buffer
+ * @param [in] context
+ * @param [in] threadId append the thread id too
+ */
+template<class Buffer>
+void AppendTextContext(Buffer& buffer, const LogContext& context, bool threadId)
+{
+    for (const LogContext::Entry& entry : context)
+    {
+        buffer.push_back(' ');
+        buffer.append(entry.key, entry.key + std::char_traits<char>::length(entry.key));
+        buffer.push_back('=');
+        buffer.append(entry.value, entry.value + entry.size);
+    }
+
+    if (threadId)
+        fmt::format_to(std::back_inserter(buffer), " {}={}", THREAD_ID_KEY, GetThreadId());
+}
+
+/**
+ * @brief Appends ,"key":"value" for every pair of the context
+ *
+ * @param [in] buffer
+ * @param [in] context
+ * @param [in] threadId append the thread id too
+ */
+template<class Buffer>
+void AppendJsonContext(Buffer& buffer, const LogContext& context, bool threadId)
+{
+    for (const LogContext::Entry& entry : context)
+    {
+        buffer.push_back(',');
+        AppendJsonString(buffer, entry.key);
+        buffer.push_back(':');
+        AppendJsonString(buffer, entry.Value());
+    }
+
+    if (threadId)
+        fmt::format_to(std::back_inserter(buffer), ",\"{}\":{}", THREAD_ID_KEY, GetThreadId());
+}
+
+/**
+ * @brief Encodes the context as named binary arguments,
+ * there are Size() + threadId of them
+ *
+ * @tparam Out BinaryBufferOut or BinaryFixedOut
+ *
+ * @param [in] out
+ * @param [in] context
+ * @param [in] threadId encode the thread id too
+ */
+template<class Out>
+void EncodeBinaryContext(Out& out, const LogContext& context, bool threadId)
+{
+    for (const LogContext::Entry& entry : context)
+        EncodeBinaryArg(out, fmt::arg(entry.key, entry.Value()));
+
+    if (threadId)
+        EncodeBinaryArg(out, fmt::arg(THREAD_ID_KEY, GetThreadId()));
+}
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_LOG_CONTEXT_HPP
+
+// NOLINTEND
@@ -0,0 +1,49 @@
+/**
+ * @file LogType.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Log record types
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_LOG_TYPE_HPP
+#define MLIB_LOGGER_LOG_TYPE_HPP
+
+#define MLIB_LOG_LEVEL_DEBUG 0
+#define MLIB_LOG_LEVEL_INFO  1
+#define MLIB_LOG_LEVEL_ERROR 2
+#define MLIB_LOG_LEVEL_OFF   3
+
+/**
+ * @brief Compile-time minimum level.
+ * Calls below it expand to nothing and their arguments are never evaluated
+ */
+#ifndef MLIB_LOG_LEVEL
+#define MLIB_LOG_LEVEL MLIB_LOG_LEVEL_DEBUG
+#endif
+
+namespace mlib {
+namespace detail {
+
+/** @enum LogType
+ * @brief Ordered by severity, available as Logger::LogType
+ */
+enum LogType
+{
+    DEBUG = MLIB_LOG_LEVEL_DEBUG,
+    INFO  = MLIB_LOG_LEVEL_INFO,
+    ERROR = MLIB_LOG_LEVEL_ERROR,
+};
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_LOG_TYPE_HPP
+
+// NOLINTEND
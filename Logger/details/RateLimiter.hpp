@@ -0,0 +1,130 @@
+/**
+ * @file RateLimiter.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Per call site rate limits of the LogEvery macros
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_RATE_LIMITER_HPP
+#define MLIB_LOGGER_RATE_LIMITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @class CallSiteLimiter
+ *
+ * @brief Decides which calls of one call site are logged.
+ * Each macro call site owns a static instance.
+ * A skipped call costs one relaxed atomic operation,
+ * the number of skipped calls is reported with the next logged one
+ */
+class CallSiteLimiter
+{
+public:
+    /**
+     * @brief Lets through the first of every n calls
+     *
+     * @param [in] n
+     * @param [out] suppressed calls skipped since the previous logged one
+     *
+     * @return true log this call
+     * @return false skip it
+     */
+    bool Every(uint64_t n, uint32_t& suppressed) noexcept
+    {
+        uint64_t call = m_calls.fetch_add(1, std::memory_order_relaxed);
+
+        if (n > 1 && call % n != 0)
+            return false;
+
+        suppressed = call == 0 || n <= 1 ? 0 : saturate(n - 1);
+        return true;
+    }
+
+    /**
+     * @brief Lets through at most one call per period
+     *
+     * @param [in] milliseconds period
+     * @param [out] suppressed calls skipped since the previous logged one
+     *
+     * @return true log this call
+     * @return false skip it
+     */
+    bool EveryMs(int64_t milliseconds, uint32_t& suppressed) noexcept
+    {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t next = m_next.load(std::memory_order_relaxed);
+
+        if (now < next ||
+            !m_next.compare_exchange_strong(next, now + milliseconds * 1'000'000, std::memory_order_relaxed))
+        {
+            m_calls.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        suppressed = saturate(m_calls.exchange(0, std::memory_order_relaxed));
+        return true;
+    }
+
+    /**
+     * @brief Lets through each call with the given probability
+     *
+     * @param [in] probability from 0 to 1
+     * @param [out] suppressed calls skipped since the previous logged one
+     *
+     * @return true log this call
+     * @return false skip it
+     */
+    bool Sample(double probability, uint32_t& suppressed) noexcept
+    {
+        if (nextRandom() >= probability)
+        {
+            m_calls.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        suppressed = saturate(m_calls.exchange(0, std::memory_order_relaxed));
+        return true;
+    }
+private:
+    std::atomic<uint64_t> m_calls{0};
+    std::atomic<int64_t>  m_next{std::numeric_limits<int64_t>::min()};
+
+    static uint32_t saturate(uint64_t count) noexcept
+    {
+        return count > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(count);
+    }
+
+    /// xorshift64*, one state per thread, returns [0, 1)
+    static double nextRandom() noexcept
+    {
+        thread_local uint64_t state = reinterpret_cast<uintptr_t>(&state) | 1;
+
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+
+        return static_cast<double>((state * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+    }
+};
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_RATE_LIMITER_HPP
+
+// NOLINTEND
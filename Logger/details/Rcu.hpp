@@ -0,0 +1,180 @@
+/**
+ * @file Rcu.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Pointer read without locks, its old values are deleted
+ * once no reader can see them
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_RCU_HPP
+#define MLIB_LOGGER_RCU_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "BoundedQueue.hpp"
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @class RcuPointer
+ *
+ * @brief Owning pointer whose value is replaced while it is being read.
+ *
+ * A reader counts itself in one of two halves of its thread's shard,
+ * the half is chosen by the parity of an epoch, then loads the pointer.
+ * A writer exchanges the pointer and calls Synchronize, which moves
+ * the epoch on twice and waits each time until the half left behind is empty.
+ * After that no reader can hold the old value and it may be deleted.
+ * Readers take no lock and never wait, writers wait for readers.
+ * A reader must not call Synchronize.
+ *
+ * @tparam T
+ */
+template<class T>
+class RcuPointer
+{
+public:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    /**
+     * @class ReadGuard
+     *
+     * @brief The value seen by a reader, it stays alive until the guard is destroyed
+     */
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(RcuPointer& pointer) noexcept
+            : m_counter(pointer.enter())
+        {
+            m_value = pointer.m_value.load(std::memory_order_seq_cst);
+        }
+
+        ~ReadGuard()
+        {
+            m_counter.fetch_sub(1, std::memory_order_release);
+        }
+
+        ReadGuard(const ReadGuard& other) = delete;
+        ReadGuard& operator=(const ReadGuard& other) = delete;
+
+        [[nodiscard]] const T* Get() const noexcept { return m_value; }
+
+        const T* operator->() const noexcept { return m_value; }
+
+        const T& operator*() const noexcept { return *m_value; }
+
+        explicit operator bool() const noexcept { return m_value != nullptr; }
+    private:
+        std::atomic<uint64_t>& m_counter;
+        const T*               m_value = nullptr;
+    };
+
+    RcuPointer() = default;
+
+    ~RcuPointer()
+    {
+        delete m_value.load(std::memory_order_relaxed);
+    }
+
+    RcuPointer(const RcuPointer& other) = delete;
+    RcuPointer& operator=(const RcuPointer& other) = delete;
+
+    /**
+     * @brief Starts reading
+     *
+     * @return ReadGuard
+     */
+    [[nodiscard]] ReadGuard Read() noexcept
+    {
+        return ReadGuard{*this};
+    }
+
+    /**
+     * @brief Publishes a new value. The old one is returned
+     * and may still be read until Synchronize returns
+     *
+     * @param [in] value
+     *
+     * @return std::unique_ptr<T> the old value
+     */
+    [[nodiscard]] std::unique_ptr<T> Exchange(std::unique_ptr<T> value) noexcept
+    {
+        return std::unique_ptr<T>(m_value.exchange(value.release(), std::memory_order_seq_cst));
+    }
+
+    /**
+     * @brief Waits until every reader that could see a value
+     * replaced before the call is gone
+     */
+    void Synchronize()
+    {
+        std::unique_lock lock(m_synchronizeMutex);
+
+        for (int i = 0; i < 2; i++)
+        {
+            size_t half = m_epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+
+            for (unsigned spins = 0; hasReaders(half); spins++)
+            {
+                if (spins < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+private:
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+        std::atomic<uint64_t> readers[2] = {};
+    };
+
+    std::atomic<T*>     m_value{nullptr};
+    std::atomic<size_t> m_epoch{0};
+    Shard               m_shards[SHARD_COUNT]{};
+    std::mutex          m_synchronizeMutex{};
+
+    std::atomic<uint64_t>& enter() noexcept
+    {
+        static std::atomic<size_t> nextIndex{0};
+        thread_local const size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+
+        std::atomic<uint64_t>& counter = m_shards[index].readers[m_epoch.load(std::memory_order_relaxed) & 1];
+        counter.fetch_add(1, std::memory_order_seq_cst);
+
+        return counter;
+    }
+
+    // A reader that loaded the old value counted itself before the exchange,
+    // so it is seen here until it leaves
+    [[nodiscard]] bool hasReaders(size_t half) const noexcept
+    {
+        for (const Shard& shard : m_shards)
+            if (shard.readers[half].load(std::memory_order_seq_cst) != 0)
+                return true;
+
+        return false;
+    }
+};
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_RCU_HPP
+
+// NOLINTEND
@@ -0,0 +1,183 @@
+/**
+ * @file RepeatFilter.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Collapses repeated records of one call site
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_REPEAT_FILTER_HPP
+#define MLIB_LOGGER_REPEAT_FILTER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "ErrorCode.hpp"
+#include "LogType.hpp"
+#include "SourcePosition.hpp"
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @class RepeatFilter
+ *
+ * @brief Tracks recent records by call site and error code.
+ *
+ * The first record of a site opens a window, later records of the same site
+ * inside the window are only counted. Sites are compared by the addresses
+ * of their static descriptors, never by contents. Each slot has its own spin lock,
+ * so records of different sites rarely touch the same cache line.
+ */
+class RepeatFilter
+{
+public:
+    static constexpr size_t SLOT_COUNT = 256;
+
+    /**
+     * @brief Records dropped as repeats of one site
+     */
+    struct Repeats
+    {
+        LogType        type = INFO;
+        err::ErrorCode errorCode{};
+        SourcePosition position{};
+        int64_t        windowStart = 0; ///< ns, time of the written record
+        int64_t        lastTime = 0;    ///< ns, time of the last dropped one
+        uint32_t       count = 0;
+    };
+
+    RepeatFilter()
+        : m_slots(new Slot[SLOT_COUNT]) {}
+
+    /**
+     * @brief Tells if a record has to be written
+     *
+     * @param [in] type
+     * @param [in] errorCode
+     * @param [in] position
+     * @param [in] time ns
+     * @param [in] window ns
+     * @param [out] repeats filled if the repeats of this slot have to be reported
+     * before the record, count is 0 otherwise
+     *
+     * @return true write the record
+     * @return false it repeats a recent one
+     */
+    bool Check(LogType type, err::ErrorCode errorCode, SourcePosition position,
+               int64_t time, int64_t window, Repeats& repeats) noexcept
+    {
+        Slot& slot = m_slots[hash(type, errorCode, position) % SLOT_COUNT];
+        SlotLock lock{slot};
+
+        if (slot.valid && matches(slot.repeats, type, errorCode, position) &&
+            time >= slot.repeats.windowStart && time - slot.repeats.windowStart < window)
+        {
+            if (slot.repeats.count < UINT32_MAX)
+                slot.repeats.count++;
+
+            slot.repeats.lastTime = time;
+            return false;
+        }
+
+        repeats = slot.repeats;
+
+        slot.valid   = true;
+        slot.repeats = Repeats{type, errorCode, position, time, time, 0};
+
+        return true;
+    }
+
+    /**
+     * @brief Calls report(repeats) for every site with dropped records
+     * and forgets all sites
+     *
+     * @tparam Report
+     *
+     * @param [in] report
+     */
+    template<class Report>
+    void Drain(Report&& report)
+    {
+        for (size_t i = 0; i < SLOT_COUNT; i++)
+        {
+            Repeats repeats{};
+
+            {
+                SlotLock lock{m_slots[i]};
+
+                repeats = m_slots[i].repeats;
+
+                m_slots[i].valid   = false;
+                m_slots[i].repeats = Repeats{};
+            }
+
+            if (repeats.count)
+                report(repeats);
+        }
+    }
+private:
+    struct Slot
+    {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        bool             valid = false;
+        Repeats          repeats{};
+    };
+
+    class SlotLock
+    {
+    public:
+        explicit SlotLock(Slot& slot) noexcept
+            : m_slot(slot)
+        {
+            while (m_slot.lock.test_and_set(std::memory_order_acquire))
+                m_slot.lock.wait(true, std::memory_order_relaxed);
+        }
+
+        ~SlotLock()
+        {
+            m_slot.lock.clear(std::memory_order_release);
+            m_slot.lock.notify_one();
+        }
+
+        SlotLock(const SlotLock& other) = delete;
+        SlotLock& operator=(const SlotLock& other) = delete;
+    private:
+        Slot& m_slot;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+
+    static size_t hash(LogType type, err::ErrorCode errorCode, SourcePosition position) noexcept
+    {
+        size_t result = std::hash<const void*>{}(position.GetSite());
+        result = result * 31 + static_cast<size_t>(errorCode);
+        result = result * 31 + static_cast<size_t>(type);
+
+        return result;
+    }
+
+    static bool matches(const Repeats& repeats, LogType type, err::ErrorCode errorCode,
+                        SourcePosition position) noexcept
+    {
+        return repeats.type               == type
+            && repeats.errorCode          == errorCode
+            && repeats.position.GetSite() == position.GetSite();
+    }
+};
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_REPEAT_FILTER_HPP
+
+// NOLINTEND
@@ -0,0 +1,152 @@
+/**
+ * @file SiteRegistry.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Call site ids for binary logging
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_SITE_REGISTRY_HPP
+#define MLIB_LOGGER_SITE_REGISTRY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+#include "BinaryFormat.hpp"
+#include "SourcePosition.hpp"
+
+namespace mlib {
+namespace detail {
+
+/**
+ * @class SiteRegistry
+ *
+ * @brief Maps call sites to small ids.
+ *
+ * A site is identified by the address of its static descriptor
+ * and of its format string, so lookups never compare string contents. Lookups are lock-free,
+ * only the first registration of a site takes a mutex.
+ */
+class SiteRegistry
+{
+public:
+    static constexpr size_t CAPACITY = BINARY_MAX_SITES;
+
+    struct Site
+    {
+        const CallSite* callSite     = nullptr;
+        const char*     fileName     = nullptr;
+        const char*     functionName = nullptr;
+        size_t          line         = 0;
+        const char*     format       = nullptr;
+        size_t          formatSize   = 0;
+
+        /// Last file generation the SITE entry was written to, owned by the writer
+        uint32_t        emittedGeneration = 0;
+    };
+
+    SiteRegistry()
+        : m_slots(new Slot[CAPACITY]) {}
+
+    /**
+     * @brief Returns the id of the site, registers it on the first call
+     *
+     * @param [in] callSite
+     * @param [in] format static format string, nullptr data if none
+     *
+     * @return uint32_t id or BINARY_INVALID_SITE if the registry is full
+     */
+    uint32_t Register(const CallSite* callSite, std::string_view format) noexcept
+    {
+        size_t start = hash(callSite, format.data());
+
+        for (size_t i = 0; i < CAPACITY; i++)
+        {
+            size_t index = (start + i) % CAPACITY;
+            Slot& slot = m_slots[index];
+
+            if (!slot.ready.load(std::memory_order_acquire))
+                return insert(start, callSite, format);
+
+            if (matches(slot.site, callSite, format))
+                return static_cast<uint32_t>(index);
+        }
+
+        return BINARY_INVALID_SITE;
+    }
+
+    /**
+     * @brief Returns a registered site
+     *
+     * @param [in] id
+     *
+     * @return Site&
+     */
+    [[nodiscard]] Site& Get(uint32_t id) noexcept { return m_slots[id].site; }
+private:
+    struct Slot
+    {
+        std::atomic<bool> ready{false};
+        Site              site{};
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::mutex              m_mutex{};
+
+    static size_t hash(const CallSite* callSite, const char* format) noexcept
+    {
+        std::hash<const void*> hasher{};
+
+        return hasher(callSite) * 31 + hasher(format);
+    }
+
+    static bool matches(const Site& site, const CallSite* callSite, std::string_view format) noexcept
+    {
+        return site.callSite   == callSite
+            && site.format     == format.data()
+            && site.formatSize == format.size();
+    }
+
+    uint32_t insert(size_t start, const CallSite* callSite, std::string_view format) noexcept
+    {
+        std::unique_lock lock(m_mutex);
+
+        for (size_t i = 0; i < CAPACITY; i++)
+        {
+            size_t index = (start + i) % CAPACITY;
+            Slot& slot = m_slots[index];
+
+            if (!slot.ready.load(std::memory_order_relaxed))
+            {
+                slot.site = Site{callSite, callSite->fileName, callSite->functionName, callSite->line,
+                                 format.data(), format.size()};
+                slot.ready.store(true, std::memory_order_release);
+
+                return static_cast<uint32_t>(index);
+            }
+
+            if (matches(slot.site, callSite, format))
+                return static_cast<uint32_t>(index);
+        }
+
+        return BINARY_INVALID_SITE;
+    }
+};
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_SITE_REGISTRY_HPP
+
+// NOLINTEND
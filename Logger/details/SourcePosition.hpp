@@ -16,29 +16,47 @@
 #define MLIB_LOGGER_SOURCE_POSITION_HPP
 
 #include <cstddef>
+#include <cstdint>
 
 namespace mlib {
 namespace detail {
 
+/**
+ * @struct CallSite
+ *
+ * @brief Static descriptor of a call site, one per macro expansion.
+ * Sites are identified by the address of their descriptor
+ */
+struct CallSite
+{
+    const char* fileName     = nullptr;
+    const char* functionName = nullptr;
+    uint32_t    line         = 0;
+};
+
+inline constexpr CallSite UNKNOWN_CALL_SITE{};
+
+/**
+ * @class SourcePosition
+ *
+ * @brief Refers to a static call site, copying it copies one pointer
+ */
 class SourcePosition {
 public:
-    virtual ~SourcePosition() = default;
+    constexpr SourcePosition() noexcept = default;
 
-    SourcePosition() = default;
+    constexpr explicit SourcePosition(const CallSite* site) noexcept
+        : m_site(site ? site : &UNKNOWN_CALL_SITE) {}
 
-    explicit SourcePosition(const char* fileName, const char* funcName,
-                   size_t line) noexcept
-        : m_fileName(fileName), m_funcName(funcName), m_line(line) {}
+    constexpr const char* GetFileName() const noexcept { return m_site->fileName; }
 
-    const char* GetFileName() const noexcept { return m_fileName; }
+    constexpr const char* GetFunctionName() const noexcept { return m_site->functionName; }
 
-    const char* GetFunctionName() const noexcept { return m_funcName; }
+    constexpr size_t GetLine() const noexcept { return m_site->line; }
 
-    size_t GetLine() const noexcept { return m_line; }
+    constexpr const CallSite* GetSite() const noexcept { return m_site; }
 private:
-    const char* m_fileName = nullptr;
-    const char* m_funcName = nullptr;
-    size_t m_line = 0;
+    const CallSite* m_site = &UNKNOWN_CALL_SITE;
 };
 
 #define GET_FILE_NAME() __FILE__
@@ -46,12 +64,26 @@ private:
 
 #if defined(__clang__) || defined(__GNUC__)
 #define GET_FUNCTION_NAME()  __PRETTY_FUNCTION__
+
+// A statement expression sees the function it is in, so the descriptor
+// is a constant in the binary and taking it costs one address load
+#define MLIB_CALL_SITE() \
+(__extension__ ({ \
+    static constexpr mlib::detail::CallSite mlibCallSite_{GET_FILE_NAME(), GET_FUNCTION_NAME(), GET_LINE()}; \
+    &mlibCallSite_; \
+}))
 #else
 #define GET_FUNCTION_NAME() __func__
+
+#define MLIB_CALL_SITE() \
+[](const char* mlibFunctionName_) noexcept { \
+    static const mlib::detail::CallSite mlibCallSite_{GET_FILE_NAME(), mlibFunctionName_, GET_LINE()}; \
+    return &mlibCallSite_; \
+}(GET_FUNCTION_NAME())
 #endif
 
 #define CURRENT_SOURCE_POSITION() \
-mlib::detail::SourcePosition(GET_FILE_NAME(), GET_FUNCTION_NAME(), GET_LINE())
+mlib::detail::SourcePosition(MLIB_CALL_SITE())
 
 } // namespace detail
 } // namespace mlib
@@ -0,0 +1,234 @@
+/**
+ * @file Stats.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Counters a logger keeps about its own cost
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_STATS_HPP
+#define MLIB_LOGGER_STATS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "BoundedQueue.hpp"
+#include "LogType.hpp"
+
+namespace mlib {
+namespace detail {
+
+inline constexpr size_t LOG_TYPE_COUNT       = 3;
+inline constexpr size_t LATENCY_BUCKET_COUNT = 32;
+inline constexpr size_t LATENCY_SAMPLE_PERIOD = 16;
+
+/**
+ * @struct StatsSnapshot
+ *
+ * @brief Logger counters summed at one moment, available as Logger::Stats.
+ * Records and bytes count what reached the sinks, bytes once per record.
+ * Latency bucket i counts sink writes that took [2^(i-1), 2^i) ns,
+ * bucket 0 the ones under 1 ns, the last one everything longer.
+ * Only one record write in LATENCY_SAMPLE_PERIOD of each thread is timed,
+ * a committed batch is one write and is always timed
+ */
+struct StatsSnapshot
+{
+    uint64_t records[LOG_TYPE_COUNT] = {};
+    uint64_t bytes[LOG_TYPE_COUNT] = {};
+    uint64_t dropped = 0;        ///< lost on the way to the sinks
+    uint64_t suppressed = 0;     ///< skipped by a rate limit or collapsed as repeats
+    uint64_t lockWaitNs = 0;     ///< waiting for the logger mutex
+    uint64_t queueWaitNs = 0;    ///< waiting for space in the async queue
+    uint64_t queueHighWater = 0; ///< most records seen in the async queue at once, sampled
+    uint64_t latency[LATENCY_BUCKET_COUNT] = {};
+
+    [[nodiscard]] uint64_t Records(LogType type) const noexcept { return records[type]; }
+    [[nodiscard]] uint64_t Bytes(LogType type) const noexcept { return bytes[type]; }
+};
+
+/**
+ * @class LoggerStats
+ *
+ * @brief Counters split into cache line sized shards.
+ *
+ * Each thread updates the shard picked by its index with relaxed atomics,
+ * so logging threads do not share cache lines unless there are more
+ * of them than shards. A snapshot sums all shards.
+ */
+class LoggerStats
+{
+public:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+        std::atomic<uint64_t> records[LOG_TYPE_COUNT] = {};
+        std::atomic<uint64_t> bytes[LOG_TYPE_COUNT] = {};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> suppressed{0};
+        std::atomic<uint64_t> lockWaitNs{0};
+        std::atomic<uint64_t> queueWaitNs{0};
+        std::atomic<uint64_t> latency[LATENCY_BUCKET_COUNT] = {};
+    };
+
+    /**
+     * @brief Returns the shard of the calling thread
+     *
+     * @return Shard&
+     */
+    [[nodiscard]] Shard& Local() noexcept
+    {
+        static std::atomic<size_t> nextIndex{0};
+        thread_local const size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+
+        return m_shards[index];
+    }
+
+    /**
+     * @brief Tells if the calling thread times its next record write,
+     * reading the clock twice per record costs more than the write to a fast sink
+     *
+     * @return true
+     * @return false
+     */
+    [[nodiscard]] static bool SampleLatency() noexcept
+    {
+        thread_local size_t writes = 0;
+
+        return writes++ % LATENCY_SAMPLE_PERIOD == 0;
+    }
+
+    /**
+     * @brief Records one sink write
+     *
+     * @param [in] type
+     * @param [in] bytes
+     */
+    void AddWrite(LogType type, size_t bytes) noexcept
+    {
+        Shard& shard = Local();
+
+        add(shard.records[type], 1);
+        add(shard.bytes[type], bytes);
+    }
+
+    /**
+     * @brief Records the time of a sampled sink write
+     *
+     * @param [in] latency
+     */
+    void AddLatency(std::chrono::nanoseconds latency) noexcept
+    {
+        add(Local().latency[bucketOf(latency)], 1);
+    }
+
+    /**
+     * @brief Records one write of several records at once,
+     * its latency is counted once
+     *
+     * @param [in] records per type
+     * @param [in] bytes per type
+     * @param [in] latency
+     */
+    void AddBatchWrite(const uint64_t (&records)[LOG_TYPE_COUNT], const uint64_t (&bytes)[LOG_TYPE_COUNT],
+                       std::chrono::nanoseconds latency) noexcept
+    {
+        Shard& shard = Local();
+
+        for (size_t i = 0; i < LOG_TYPE_COUNT; i++)
+        {
+            if (!records[i]) continue;
+
+            add(shard.records[i], records[i]);
+            add(shard.bytes[i], bytes[i]);
+        }
+
+        add(shard.latency[bucketOf(latency)], 1);
+    }
+
+    void AddDropped(uint64_t count) noexcept { add(Local().dropped, count); }
+
+    void AddSuppressed(uint64_t count) noexcept { add(Local().suppressed, count); }
+
+    void AddLockWait(std::chrono::nanoseconds wait) noexcept { add(Local().lockWaitNs, toCount(wait)); }
+
+    void AddQueueWait(std::chrono::nanoseconds wait) noexcept { add(Local().queueWaitNs, toCount(wait)); }
+
+    /**
+     * @brief Raises the queue high-water mark, called by the async worker only
+     *
+     * @param [in] depth
+     */
+    void UpdateQueueDepth(size_t depth) noexcept
+    {
+        if (depth > m_queueHighWater.load(std::memory_order_relaxed))
+            m_queueHighWater.store(depth, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Sums the shards, concurrent updates may or may not be included
+     *
+     * @return StatsSnapshot
+     */
+    [[nodiscard]] StatsSnapshot Snapshot() const noexcept
+    {
+        StatsSnapshot snapshot{};
+
+        for (const Shard& shard : m_shards)
+        {
+            for (size_t i = 0; i < LOG_TYPE_COUNT; i++)
+            {
+                snapshot.records[i] += shard.records[i].load(std::memory_order_relaxed);
+                snapshot.bytes[i]   += shard.bytes[i].load(std::memory_order_relaxed);
+            }
+
+            for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++)
+                snapshot.latency[i] += shard.latency[i].load(std::memory_order_relaxed);
+
+            snapshot.dropped     += shard.dropped.load(std::memory_order_relaxed);
+            snapshot.suppressed  += shard.suppressed.load(std::memory_order_relaxed);
+            snapshot.lockWaitNs  += shard.lockWaitNs.load(std::memory_order_relaxed);
+            snapshot.queueWaitNs += shard.queueWaitNs.load(std::memory_order_relaxed);
+        }
+
+        snapshot.queueHighWater = m_queueHighWater.load(std::memory_order_relaxed);
+
+        return snapshot;
+    }
+private:
+    Shard                 m_shards[SHARD_COUNT]{};
+    std::atomic<uint64_t> m_queueHighWater{0};
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) noexcept
+    {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static uint64_t toCount(std::chrono::nanoseconds duration) noexcept
+    {
+        return duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+    }
+
+    static size_t bucketOf(std::chrono::nanoseconds latency) noexcept
+    {
+        return std::min<size_t>(std::bit_width(toCount(latency)), LATENCY_BUCKET_COUNT - 1);
+    }
+};
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_STATS_HPP
+
+// NOLINTEND
@@ -0,0 +1,144 @@
+/**
+ * @file Timestamp.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief Cached timestamp formatting
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_TIMESTAMP_HPP
+#define MLIB_LOGGER_TIMESTAMP_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <string_view>
+
+namespace mlib {
+namespace detail {
+
+/** @enum TimestampPrecision
+ * @brief How many sub-second digits a timestamp has
+ */
+enum class TimestampPrecision
+{
+    SECONDS      = 0,
+    MILLISECONDS = 3,
+    MICROSECONDS = 6,
+};
+
+/**
+ * @class TimestampCache
+ *
+ * @brief Renders "dd/mm/YYYY HH:MM:SS.ffffff TZ" timestamps.
+ *
+ * The date, time and zone are rendered once per second,
+ * later calls within the same second only patch the sub-second digits.
+ * Not thread-safe, use one instance per thread, @see GetThreadTimestampCache
+ */
+class TimestampCache
+{
+public:
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    /**
+     * @brief Formats the time
+     *
+     * @param [in] time
+     * @param [in] precision
+     *
+     * @return std::string_view valid until the next call
+     */
+    std::string_view Format(TimePoint time, TimestampPrecision precision) noexcept
+    {
+        using namespace std::chrono;
+
+        int64_t micros  = duration_cast<microseconds>(time.time_since_epoch()).count();
+        int64_t seconds = micros / 1'000'000;
+        int64_t fraction = micros % 1'000'000;
+
+        if (fraction < 0)
+        {
+            fraction += 1'000'000;
+            seconds  -= 1;
+        }
+
+        if (seconds != m_second || precision != m_precision)
+            render(seconds, precision);
+
+        int digits = static_cast<int>(precision);
+
+        for (int i = 6; i > digits; i--)
+            fraction /= 10;
+
+        for (int i = digits - 1; i >= 0; i--)
+        {
+            m_rendered[m_fractionPos + static_cast<size_t>(i)] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+
+        return {m_rendered, m_size};
+    }
+private:
+    static constexpr size_t RENDERED_CAPACITY = 96;
+
+    int64_t            m_second = std::numeric_limits<int64_t>::min();
+    TimestampPrecision m_precision = TimestampPrecision::SECONDS;
+    size_t             m_fractionPos = 0;
+    size_t             m_size = 0;
+    char               m_rendered[RENDERED_CAPACITY] = {};
+
+    void render(int64_t seconds, TimestampPrecision precision) noexcept
+    {
+        std::time_t t = static_cast<std::time_t>(seconds);
+        std::tm tm{};
+#ifdef _WIN32
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+
+        size_t size = std::strftime(m_rendered, RENDERED_CAPACITY, "%d/%m/%Y %H:%M:%S", &tm);
+
+        int digits = static_cast<int>(precision);
+        if (digits > 0)
+            m_rendered[size++] = '.';
+
+        m_fractionPos = size;
+        size += static_cast<size_t>(digits);
+
+        m_rendered[size++] = ' ';
+        size_t zoneSize = std::strftime(m_rendered + size, RENDERED_CAPACITY - size, "%Z", &tm);
+        if (zoneSize == 0)
+            size--;
+
+        m_size      = size + zoneSize;
+        m_second    = seconds;
+        m_precision = precision;
+    }
+};
+
+/**
+ * @brief Returns the calling thread's timestamp cache
+ *
+ * @return TimestampCache&
+ */
+inline TimestampCache& GetThreadTimestampCache() noexcept
+{
+    thread_local TimestampCache cache{};
+    return cache;
+}
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_TIMESTAMP_HPP
+
+// NOLINTEND
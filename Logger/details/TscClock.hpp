@@ -0,0 +1,241 @@
+/**
+ * @file TscClock.hpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief CPU tick counter and its conversion to wall-clock time
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// NOLINTBEGIN
+
+#ifndef MLIB_LOGGER_TSC_CLOCK_HPP
+#define MLIB_LOGGER_TSC_CLOCK_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace mlib {
+
+/**
+ * @brief Returns ticks passed since CPU start.
+ * On targets other than x86 it is steady_clock nanoseconds
+ *
+ * @return u64 - number of ticks
+ */
+inline __attribute__((always_inline)) uint64_t GetCPUTicks() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t  lo, hi;
+    asm volatile("lfence");
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    asm volatile("lfence");
+    return (hi << 32) + lo;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+namespace detail {
+
+/**
+ * @struct CpuTicks
+ *
+ * @brief A time taken with GetCPUTicks, converted to wall-clock time later
+ */
+struct CpuTicks
+{
+    uint64_t value = 0;
+};
+
+/**
+ * @class TscClock
+ *
+ * @brief Maps CPU ticks to system_clock time.
+ *
+ * The mapping is an anchor, a tick count and the wall-clock time read
+ * at the same moment, and a rate measured against steady_clock since
+ * the clock was made, so setting the system clock does not change the rate.
+ * A conversion more than RECALIBRATION_INTERVAL after the anchor, or longer
+ * than the rate was measured for, takes a new anchor. So a young clock recalibrates
+ * often while its rate is rough and the result follows the system clock when it is set.
+ * Anchors are published with a sequence counter, conversions take no lock
+ * and may run on any thread. Assumes an invariant TSC synchronized across cores,
+ * on targets other than x86 the ticks come from steady_clock.
+ */
+class TscClock
+{
+public:
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    static constexpr std::chrono::nanoseconds RECALIBRATION_INTERVAL = std::chrono::seconds(1);
+    static constexpr std::chrono::nanoseconds INITIAL_CALIBRATION    = std::chrono::milliseconds(1);
+
+    /**
+     * @brief Measures the initial rate, spins for INITIAL_CALIBRATION
+     */
+    TscClock() noexcept
+    {
+        m_origin = sample();
+
+        Sample now{};
+
+        do
+        {
+            now = sample();
+        } while (now.steadyNs - m_origin.steadyNs < INITIAL_CALIBRATION.count() || now.ticks <= m_origin.ticks);
+
+        publish(now);
+    }
+
+    TscClock(const TscClock& other) = delete;
+    TscClock& operator=(const TscClock& other) = delete;
+
+    /**
+     * @brief Converts a tick count, recalibrates if the anchor is old
+     *
+     * @param [in] ticks
+     *
+     * @return TimePoint
+     */
+    [[nodiscard]] TimePoint ToTime(uint64_t ticks) noexcept
+    {
+        Anchor anchor = load();
+
+        if (static_cast<int64_t>(ticks - anchor.ticks) > static_cast<int64_t>(anchor.intervalTicks))
+        {
+            recalibrate();
+            anchor = load();
+        }
+
+        double delta = static_cast<double>(static_cast<int64_t>(ticks - anchor.ticks)) * anchor.nsPerTick;
+        int64_t ns = anchor.ns + static_cast<int64_t>(std::llround(delta));
+
+        return TimePoint{std::chrono::duration_cast<TimePoint::duration>(std::chrono::nanoseconds(ns))};
+    }
+private:
+    struct Anchor
+    {
+        uint64_t ticks = 0;
+        int64_t  ns = 0;
+        double   nsPerTick = 0;
+        uint64_t intervalTicks = 0;
+    };
+
+    struct Sample
+    {
+        uint64_t ticks = 0;
+        int64_t  steadyNs = 0;
+        int64_t  wallNs = 0;
+    };
+
+    Sample m_origin{};
+
+    std::atomic<uint64_t> m_sequence{0};
+    std::atomic<uint64_t> m_ticks{0};
+    std::atomic<int64_t>  m_ns{0};
+    std::atomic<double>   m_nsPerTick{0};
+    std::atomic<uint64_t> m_intervalTicks{0};
+    std::atomic_flag      m_calibrating = ATOMIC_FLAG_INIT;
+
+    /// The ticks are the middle of two reads around the clock reads
+    static Sample sample() noexcept
+    {
+        using namespace std::chrono;
+
+        uint64_t before = GetCPUTicks();
+        auto steady = steady_clock::now();
+        auto wall   = system_clock::now();
+        uint64_t after = GetCPUTicks();
+
+        return {before + (after - before) / 2,
+                duration_cast<nanoseconds>(steady.time_since_epoch()).count(),
+                duration_cast<nanoseconds>(wall.time_since_epoch()).count()};
+    }
+
+    void recalibrate() noexcept
+    {
+        // Somebody else is taking the anchor, theirs is as good
+        if (m_calibrating.test_and_set(std::memory_order_acquire)) return;
+
+        publish(sample());
+
+        m_calibrating.clear(std::memory_order_release);
+    }
+
+    /// Called by one thread at a time. The wall clock only places the anchor,
+    /// a sample whose ticks did not move forward keeps the previous rate
+    void publish(const Sample& now) noexcept
+    {
+        uint64_t ticks = now.ticks;
+        int64_t  ns    = now.wallNs;
+        double nsPerTick = m_nsPerTick.load(std::memory_order_relaxed);
+
+        if (ticks > m_origin.ticks && now.steadyNs > m_origin.steadyNs)
+            nsPerTick = static_cast<double>(now.steadyNs - m_origin.steadyNs) /
+                        static_cast<double>(ticks - m_origin.ticks);
+
+        if (!(nsPerTick > 0) || !std::isfinite(nsPerTick)) return;
+
+        auto intervalTicks = static_cast<uint64_t>(static_cast<double>(RECALIBRATION_INTERVAL.count()) / nsPerTick);
+
+        if (ticks > m_origin.ticks)
+            intervalTicks = std::min(intervalTicks, ticks - m_origin.ticks);
+
+        uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+
+        // A reader that sees any of the new fields sees the odd sequence too
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+
+        m_ticks.store(ticks, std::memory_order_release);
+        m_ns.store(ns, std::memory_order_release);
+        m_nsPerTick.store(nsPerTick, std::memory_order_release);
+        m_intervalTicks.store(intervalTicks, std::memory_order_release);
+
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    [[nodiscard]] Anchor load() const noexcept
+    {
+        Anchor anchor{};
+        uint64_t sequence = 0;
+
+        do
+        {
+            sequence = m_sequence.load(std::memory_order_acquire);
+
+            anchor.ticks         = m_ticks.load(std::memory_order_acquire);
+            anchor.ns            = m_ns.load(std::memory_order_acquire);
+            anchor.nsPerTick     = m_nsPerTick.load(std::memory_order_acquire);
+            anchor.intervalTicks = m_intervalTicks.load(std::memory_order_acquire);
+        } while ((sequence & 1) || sequence != m_sequence.load(std::memory_order_relaxed));
+
+        return anchor;
+    }
+};
+
+/**
+ * @brief Returns the clock shared by all loggers, calibrated on the first call
+ *
+ * @return TscClock&
+ */
+inline TscClock& GetTscClock() noexcept
+{
+    static TscClock clock{};
+
+    return clock;
+}
+
+} // namespace detail
+} // namespace mlib
+
+#endif // MLIB_LOGGER_TSC_CLOCK_HPP
+
+// NOLINTEND
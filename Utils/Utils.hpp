@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "Result.hpp"
+#include "details/TscClock.hpp"
 
 #define ArrayLength(array) sizeof(array) / sizeof(*(array))
 
@@ -159,20 +160,6 @@ err::Result<Float> ParseNumber(std::string_view string)
     return err::Result<Float>{result};
 }
 
-/**
- * @brief Returns ticks passed since CPU start
- *
- * @return u64 - number of ticks
- */
-inline __attribute__((always_inline)) uint64_t GetCPUTicks() noexcept
-{
-    uint64_t  lo, hi;
-    asm volatile("lfence");
-    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
-    asm volatile("lfence");
-    return (hi << 32) + lo;
-}
-
 struct TickTimer
 {
 public:
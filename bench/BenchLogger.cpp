@@ -0,0 +1,513 @@
+/**
+ * @file BenchLogger.cpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief mlibBenchLogger measures Logger::Log throughput and per call latency
+ *
+ * Every combination of the selected thread counts, message sizes, sinks,
+ * modes and formats is run in turn. Each thread logs the same number of records,
+ * every call is timed with TickTimer. One result per combination is printed
+ * as CSV or JSON Lines.
+ *
+ * Usage: mlibBenchLogger [options]
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+//NOLINTBEGIN
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <latch>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+using namespace mlib;
+
+namespace {
+
+constexpr size_t WARMUP_RECORDS = 1000;
+
+enum class SinkKind
+{
+    FILE,
+    DEV_NULL,
+    MEMORY,
+#ifdef __linux
+    URING,
+    MAPPED,
+#endif
+};
+
+enum class ResultFormat
+{
+    CSV,
+    JSON,
+};
+
+struct Options
+{
+    std::vector<size_t>               threads{};
+    std::vector<size_t>               sizes{16, 128, 1024};
+    std::vector<SinkKind>             sinks{SinkKind::FILE, SinkKind::DEV_NULL, SinkKind::MEMORY};
+    std::vector<bool>                 async{false, true};
+    std::vector<Logger::OutputFormat> formats{Logger::OutputFormat::TEXT, Logger::OutputFormat::BINARY};
+    size_t                            records = 100000;
+    std::string                       directory = ".";
+    const char*                       outputPath = nullptr;
+    ResultFormat                      resultFormat = ResultFormat::CSV;
+};
+
+struct Case
+{
+    size_t               threads = 1;
+    size_t               size = 0;
+    SinkKind             sink = SinkKind::FILE;
+    bool                 async = false;
+    Logger::OutputFormat format = Logger::OutputFormat::TEXT;
+};
+
+struct Measurement
+{
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    double   seconds = 0;
+    double   p50 = 0; ///< ns, same for the rest
+    double   p90 = 0;
+    double   p99 = 0;
+    double   p999 = 0;
+    double   max = 0;
+    uint64_t lockWaitNs = 0;
+    uint64_t queueWaitNs = 0;
+};
+
+void printUsage(const char* name)
+{
+    fmt::print(stderr,
+               "Usage: {} [options]\n"
+               "  -t, --threads <list>   threads logging at once, default 1,2,4,.. up to the cores\n"
+               "  -s, --sizes <list>     message sizes in bytes, default 16,128,1024\n"
+               "      --sinks <list>     file, null, memory"
+#ifdef __linux
+               ", uring, mapped"
+#endif
+               ", default file,null,memory\n"
+               "  -m, --modes <list>     sync, async, default both\n"
+               "  -f, --formats <list>   text, binary, json, default text,binary\n"
+               "  -n, --records <n>      records per thread, default 100000\n"
+               "  -d, --dir <path>       directory for the file sinks, default .\n"
+               "  -o, --output <path>    where the results go, default stdout\n"
+               "      --json             JSON Lines results instead of CSV\n",
+               name);
+}
+
+std::vector<std::string_view> splitList(std::string_view list)
+{
+    std::vector<std::string_view> items{};
+
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        items.push_back(list.substr(0, comma));
+
+        if (comma == std::string_view::npos)
+            break;
+
+        list.remove_prefix(comma + 1);
+    }
+
+    return items;
+}
+
+bool parseNumber(std::string_view string, size_t& number)
+{
+    std::string copy{string};
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(copy.c_str(), &end, 10);
+
+    if (copy.empty() || *end != '\0' || value == 0)
+        return false;
+
+    number = static_cast<size_t>(value);
+    return true;
+}
+
+bool parseNumbers(std::string_view list, std::vector<size_t>& numbers)
+{
+    numbers.clear();
+
+    for (std::string_view item : splitList(list))
+    {
+        size_t number = 0;
+        if (!parseNumber(item, number)) return false;
+
+        numbers.push_back(number);
+    }
+
+    return !numbers.empty();
+}
+
+bool parseSinks(std::string_view list, std::vector<SinkKind>& sinks)
+{
+    sinks.clear();
+
+    for (std::string_view sink : splitList(list))
+    {
+        if (sink == "file")
+            sinks.push_back(SinkKind::FILE);
+        else if (sink == "null")
+            sinks.push_back(SinkKind::DEV_NULL);
+        else if (sink == "memory")
+            sinks.push_back(SinkKind::MEMORY);
+#ifdef __linux
+        else if (sink == "uring")
+            sinks.push_back(SinkKind::URING);
+        else if (sink == "mapped")
+            sinks.push_back(SinkKind::MAPPED);
+#endif
+        else
+            return false;
+    }
+
+    return !sinks.empty();
+}
+
+bool parseModes(std::string_view list, std::vector<bool>& async)
+{
+    async.clear();
+
+    for (std::string_view mode : splitList(list))
+    {
+        if (mode == "sync")
+            async.push_back(false);
+        else if (mode == "async")
+            async.push_back(true);
+        else
+            return false;
+    }
+
+    return !async.empty();
+}
+
+bool parseFormats(std::string_view list, std::vector<Logger::OutputFormat>& formats)
+{
+    formats.clear();
+
+    for (std::string_view format : splitList(list))
+    {
+        if (format == "text")
+            formats.push_back(Logger::OutputFormat::TEXT);
+        else if (format == "binary")
+            formats.push_back(Logger::OutputFormat::BINARY);
+        else if (format == "json")
+            formats.push_back(Logger::OutputFormat::JSON);
+        else
+            return false;
+    }
+
+    return !formats.empty();
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if ((arg == "-t" || arg == "--threads") && hasValue)
+        {
+            if (!parseNumbers(argv[++i], options.threads)) return false;
+        }
+        else if ((arg == "-s" || arg == "--sizes") && hasValue)
+        {
+            if (!parseNumbers(argv[++i], options.sizes)) return false;
+        }
+        else if (arg == "--sinks" && hasValue)
+        {
+            if (!parseSinks(argv[++i], options.sinks)) return false;
+        }
+        else if ((arg == "-m" || arg == "--modes") && hasValue)
+        {
+            if (!parseModes(argv[++i], options.async)) return false;
+        }
+        else if ((arg == "-f" || arg == "--formats") && hasValue)
+        {
+            if (!parseFormats(argv[++i], options.formats)) return false;
+        }
+        else if ((arg == "-n" || arg == "--records") && hasValue)
+        {
+            if (!parseNumber(argv[++i], options.records)) return false;
+        }
+        else if ((arg == "-d" || arg == "--dir") && hasValue)
+        {
+            options.directory = argv[++i];
+        }
+        else if ((arg == "-o" || arg == "--output") && hasValue)
+        {
+            options.outputPath = argv[++i];
+        }
+        else if (arg == "--json")
+        {
+            options.resultFormat = ResultFormat::JSON;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (options.threads.empty())
+    {
+        size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+        for (size_t threads = 1; threads < cores; threads *= 2)
+            options.threads.push_back(threads);
+
+        options.threads.push_back(cores);
+    }
+
+    return true;
+}
+
+std::string_view getSinkName(SinkKind sink) noexcept
+{
+    switch (sink)
+    {
+        case SinkKind::FILE:     return "file";
+        case SinkKind::DEV_NULL: return "null";
+        case SinkKind::MEMORY:   return "memory";
+#ifdef __linux
+        case SinkKind::URING:    return "uring";
+        case SinkKind::MAPPED:   return "mapped";
+#endif
+        default:                 return "unknown";
+    }
+}
+
+std::string_view getFormatName(Logger::OutputFormat format) noexcept
+{
+    switch (format)
+    {
+        case Logger::OutputFormat::TEXT:   return "text";
+        case Logger::OutputFormat::BINARY: return "binary";
+        case Logger::OutputFormat::JSON:   return "json";
+        default:                           return "unknown";
+    }
+}
+
+std::shared_ptr<Sink> makeSink(SinkKind sink, const char* path)
+{
+    switch (sink)
+    {
+        case SinkKind::FILE:     return std::make_shared<FileSink>(path);
+        case SinkKind::DEV_NULL: return std::make_shared<FileSink>("/dev/null");
+        case SinkKind::MEMORY:   return std::make_shared<RingSink>(64 << 20);
+#ifdef __linux
+        case SinkKind::URING:    return std::make_shared<UringFileSink>(path);
+        case SinkKind::MAPPED:   return std::make_shared<MappedFileSink>(path);
+#endif
+        default:                 return nullptr;
+    }
+}
+
+/**
+ * @brief Measures how many nanoseconds a TSC tick takes
+ *
+ * @return double
+ */
+double calibrateTicks()
+{
+    Timer timer{};
+    TickTimer ticks{};
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    uint64_t elapsedTicks = ticks.Stop();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(timer.Stop());
+
+    return static_cast<double>(elapsed.count()) / static_cast<double>(std::max<uint64_t>(elapsedTicks, 1));
+}
+
+double percentile(const std::vector<uint64_t>& sorted, double fraction, double nsPerTick) noexcept
+{
+    if (sorted.empty()) return 0;
+
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted[index]) * nsPerTick;
+}
+
+Measurement runCase(const Options& options, const Case& test, double nsPerTick)
+{
+    std::string path = options.directory + "/mlib-bench.log";
+    std::string payload(test.size, 'x');
+
+    Logger logger{makeSink(test.sink, path.c_str())};
+    logger.SetOutputFormat(test.format);
+
+    if (test.async)
+        logger.EnableAsync();
+
+    for (size_t i = 0; i < WARMUP_RECORDS; i++)
+        logger.LogInfo("bench {} {}", i, std::string_view{payload});
+
+    logger.Flush();
+
+    Logger::Stats before = logger.GetStats();
+
+    std::vector<std::vector<uint64_t>> ticks(test.threads);
+    std::vector<std::thread> threads{};
+    std::latch start{static_cast<std::ptrdiff_t>(test.threads + 1)};
+
+    for (size_t t = 0; t < test.threads; t++)
+    {
+        threads.emplace_back([&, t]
+        {
+            std::vector<uint64_t>& local = ticks[t];
+            local.resize(options.records);
+
+            start.arrive_and_wait();
+
+            for (size_t i = 0; i < options.records; i++)
+            {
+                TickTimer timer{};
+                logger.LogInfo("bench {} {}", i, std::string_view{payload});
+                local[i] = timer.Stop();
+            }
+        });
+    }
+
+    start.arrive_and_wait();
+    Timer timer{};
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    logger.Flush();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(timer.Stop());
+
+    Logger::Stats after = logger.GetStats();
+
+    std::vector<uint64_t> all{};
+    all.reserve(test.threads * options.records);
+
+    for (const std::vector<uint64_t>& local : ticks)
+        all.insert(all.end(), local.begin(), local.end());
+
+    std::sort(all.begin(), all.end());
+
+    Measurement measurement{};
+
+    measurement.records     = all.size();
+    measurement.bytes       = after.Bytes(Logger::INFO) - before.Bytes(Logger::INFO);
+    measurement.seconds     = static_cast<double>(elapsed.count()) / 1e9;
+    measurement.p50         = percentile(all, 0.5, nsPerTick);
+    measurement.p90         = percentile(all, 0.9, nsPerTick);
+    measurement.p99         = percentile(all, 0.99, nsPerTick);
+    measurement.p999        = percentile(all, 0.999, nsPerTick);
+    measurement.max         = percentile(all, 1, nsPerTick);
+    measurement.lockWaitNs  = after.lockWaitNs - before.lockWaitNs;
+    measurement.queueWaitNs = after.queueWaitNs - before.queueWaitNs;
+
+    logger.SetLogFile(nullptr);
+    std::remove(path.c_str());
+
+    return measurement;
+}
+
+void printHeader(FILE* out, ResultFormat format)
+{
+    if (format == ResultFormat::CSV)
+        fmt::print(out, "threads,size,sink,mode,format,records,seconds,records_per_sec,mb_per_sec,"
+                        "p50_ns,p90_ns,p99_ns,p999_ns,max_ns,lock_wait_ns,queue_wait_ns\n");
+}
+
+void printResult(FILE* out, ResultFormat format, const Case& test, const Measurement& measurement)
+{
+    double seconds = std::max(measurement.seconds, 1e-9);
+    double recordsPerSec = static_cast<double>(measurement.records) / seconds;
+    double mbPerSec = static_cast<double>(measurement.bytes) / seconds / (1 << 20);
+
+    std::string_view mode = test.async ? "async" : "sync";
+
+    if (format == ResultFormat::CSV)
+    {
+        fmt::print(out, "{},{},{},{},{},{},{:.6f},{:.0f},{:.2f},{:.0f},{:.0f},{:.0f},{:.0f},{:.0f},{},{}\n",
+                   test.threads, test.size, getSinkName(test.sink), mode, getFormatName(test.format),
+                   measurement.records, measurement.seconds, recordsPerSec, mbPerSec,
+                   measurement.p50, measurement.p90, measurement.p99, measurement.p999, measurement.max,
+                   measurement.lockWaitNs, measurement.queueWaitNs);
+    }
+    else
+    {
+        fmt::print(out, "{{\"threads\":{},\"size\":{},\"sink\":\"{}\",\"mode\":\"{}\",\"format\":\"{}\","
+                        "\"records\":{},\"seconds\":{:.6f},\"records_per_sec\":{:.0f},\"mb_per_sec\":{:.2f},"
+                        "\"p50_ns\":{:.0f},\"p90_ns\":{:.0f},\"p99_ns\":{:.0f},\"p999_ns\":{:.0f},\"max_ns\":{:.0f},"
+                        "\"lock_wait_ns\":{},\"queue_wait_ns\":{}}}\n",
+                   test.threads, test.size, getSinkName(test.sink), mode, getFormatName(test.format),
+                   measurement.records, measurement.seconds, recordsPerSec, mbPerSec,
+                   measurement.p50, measurement.p90, measurement.p99, measurement.p999, measurement.max,
+                   measurement.lockWaitNs, measurement.queueWaitNs);
+    }
+
+    std::fflush(out);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options{};
+
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FILE* out = stdout;
+
+    if (options.outputPath)
+    {
+        out = std::fopen(options.outputPath, "w");
+
+        if (!out)
+        {
+            fmt::print(stderr, "{}: cannot open\n", options.outputPath);
+            return 2;
+        }
+    }
+
+    double nsPerTick = calibrateTicks();
+
+    printHeader(out, options.resultFormat);
+
+    for (size_t threads : options.threads)
+        for (size_t size : options.sizes)
+            for (SinkKind sink : options.sinks)
+                for (bool async : options.async)
+                    for (Logger::OutputFormat format : options.formats)
+                    {
+                        Case test{threads, size, sink, async, format};
+                        printResult(out, options.resultFormat, test, runCase(options, test, nsPerTick));
+                    }
+
+    if (out != stdout)
+        std::fclose(out);
+
+    return 0;
+}
+
+//NOLINTEND
@@ -29,7 +29,7 @@ int main()
     }
 
     if (words->size() != 923)
-        GlobalLogError(ERROR_BAD_VALUE, "Wrong number of words!!!: %zu\n", words->size());
+        GlobalLogError(ERROR_BAD_VALUE, "Wrong number of words!!!: {}", words->size());
 
     for (auto it = words->rbegin(), end = words->rend(); it != end; ++it)
         std::cout << *it << '\n';
@@ -0,0 +1,461 @@
+/**
+ * @file LogCat.cpp
+ * @author Misha Solodilov (mihsolodilov2015@gmail.com)
+ * @brief mlib-logcat renders binary logs as text
+ *
+ * Usage: mlib-logcat [options] <log file>
+ *
+ * @version 3.0
+ * @date 03.12.2024
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+//NOLINTBEGIN
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+#include "Logger.hpp"
+
+using namespace mlib;
+
+namespace {
+
+constexpr size_t OUTPUT_FLUSH_SIZE = 1 << 16;
+
+struct Options
+{
+    const char*                  path = nullptr;
+    unsigned                     typeMask = ~0u;
+    std::vector<bool>            errors{};
+    int64_t                      from = std::numeric_limits<int64_t>::min();
+    int64_t                      to   = std::numeric_limits<int64_t>::max();
+    bool                         colored = false;
+    Logger::TimestampPrecision   precision = Logger::TimestampPrecision::MILLISECONDS;
+};
+
+struct Site
+{
+    bool        valid = false;
+    std::string fileName{};
+    std::string functionName{};
+    std::string format{};
+    uint32_t    line = 0;
+    bool        hasFormat = false;
+};
+
+/**
+ * @class MappedFile
+ *
+ * @brief Read-only view of a whole file, memory-mapped on linux
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const char* path) noexcept
+    {
+#ifdef __linux
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st{};
+        bool statOk = fstat(fd, &st) == 0;
+        size_t size = statOk ? static_cast<size_t>(st.st_size) : 0;
+
+        if (statOk && size == 0)
+        {
+            m_data = "";
+        }
+        else if (statOk)
+        {
+            void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                madvise(data, size, MADV_SEQUENTIAL);
+                m_data = static_cast<const char*>(data);
+                m_size = size;
+            }
+        }
+
+        close(fd);
+#else
+        std::ifstream file{path, std::ios::binary};
+        if (!file.is_open()) return;
+
+        m_contents.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+        m_data = m_contents.data();
+        m_size = m_contents.size();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef __linux
+        if (m_size > 0)
+            munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    [[nodiscard]] operator bool() const noexcept { return m_data; }
+    [[nodiscard]] const char* Data() const noexcept { return m_data; }
+    [[nodiscard]] size_t Size() const noexcept { return m_size; }
+private:
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+#ifndef __linux
+    std::string m_contents{};
+#endif
+};
+
+void printUsage(const char* program)
+{
+    fmt::print(stderr,
+        "Usage: {} [options] <log file>\n"
+        "Renders a binary mlib log as text.\n\n"
+        "  -t, --type TYPES      comma separated DEBUG, INFO, ERROR\n"
+        "  -e, --error CODES     comma separated error names or numbers of known errors\n"
+        "      --from SECONDS    skip records before this unix time\n"
+        "      --to SECONDS      skip records after this unix time\n"
+        "  -p, --precision P     timestamp precision: s, ms or us\n"
+        "  -c, --color           color the output, default if stdout is a tty and NO_COLOR is unset\n"
+        "      --no-color        never color the output\n"
+        "  -h, --help            show this message\n",
+        program);
+}
+
+std::vector<std::string_view> splitList(std::string_view list)
+{
+    std::vector<std::string_view> items;
+
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        items.push_back(list.substr(0, comma));
+
+        if (comma == std::string_view::npos)
+            break;
+
+        list.remove_prefix(comma + 1);
+    }
+
+    return items;
+}
+
+bool parseTypes(std::string_view list, unsigned& mask)
+{
+    mask = 0;
+
+    for (std::string_view type : splitList(list))
+    {
+        if (type == "DEBUG")
+            mask |= 1u << Logger::DEBUG;
+        else if (type == "INFO")
+            mask |= 1u << Logger::INFO;
+        else if (type == "ERROR")
+            mask |= 1u << Logger::ERROR;
+        else
+            return false;
+    }
+
+    return true;
+}
+
+/// Error codes are numbered from 0 without gaps
+int knownErrorCount()
+{
+    int count = 0;
+
+    while (std::strcmp(err::GetErrorName(static_cast<err::ErrorCode>(count)), "UNKNOWN ERROR") != 0)
+        count++;
+
+    return count;
+}
+
+bool parseErrors(std::string_view list, std::vector<bool>& errors)
+{
+    const int known = knownErrorCount();
+
+    for (std::string_view name : splitList(list))
+    {
+        int code = -1;
+
+        for (int i = 0; i < known; i++)
+        {
+            if (name == err::GetErrorName(static_cast<err::ErrorCode>(i)))
+            {
+                code = i;
+                break;
+            }
+        }
+
+        if (code < 0)
+        {
+            char* end = nullptr;
+            std::string number{name};
+            long value = std::strtol(number.c_str(), &end, 10);
+
+            // Only known codes are accepted, a large number would size the filter
+            if (number.empty() || *end != '\0' || value < 0 || value >= known)
+                return false;
+
+            code = static_cast<int>(value);
+        }
+
+        if (errors.size() <= static_cast<size_t>(code))
+            errors.resize(static_cast<size_t>(code) + 1);
+
+        errors[static_cast<size_t>(code)] = true;
+    }
+
+    return true;
+}
+
+bool parseSeconds(const char* string, int64_t& nanoseconds)
+{
+    char* end = nullptr;
+    double seconds = std::strtod(string, &end);
+
+    if (end == string || *end != '\0')
+        return false;
+
+    nanoseconds = static_cast<int64_t>(seconds * 1e9);
+    return true;
+}
+
+bool parsePrecision(std::string_view string, Logger::TimestampPrecision& precision)
+{
+    if (string == "s")
+        precision = Logger::TimestampPrecision::SECONDS;
+    else if (string == "ms")
+        precision = Logger::TimestampPrecision::MILLISECONDS;
+    else if (string == "us")
+        precision = Logger::TimestampPrecision::MICROSECONDS;
+    else
+        return false;
+
+    return true;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    options.colored = detail::ResolveColors(stdout, detail::ColorMode::AUTO);
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if ((arg == "-t" || arg == "--type") && hasValue)
+        {
+            if (!parseTypes(argv[++i], options.typeMask)) return false;
+        }
+        else if ((arg == "-e" || arg == "--error") && hasValue)
+        {
+            if (!parseErrors(argv[++i], options.errors)) return false;
+        }
+        else if (arg == "--from" && hasValue)
+        {
+            if (!parseSeconds(argv[++i], options.from)) return false;
+        }
+        else if (arg == "--to" && hasValue)
+        {
+            if (!parseSeconds(argv[++i], options.to)) return false;
+        }
+        else if ((arg == "-p" || arg == "--precision") && hasValue)
+        {
+            if (!parsePrecision(argv[++i], options.precision)) return false;
+        }
+        else if (arg == "-c" || arg == "--color")
+        {
+            options.colored = true;
+        }
+        else if (arg == "--no-color")
+        {
+            options.colored = false;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            return false;
+        }
+        else if (!options.path)
+        {
+            options.path = argv[i];
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.path != nullptr;
+}
+
+bool isSelected(const Options& options, const detail::BinaryRecordView& record)
+{
+    if (options.typeMask != ~0u && (record.type >= 32 || !(options.typeMask & (1u << record.type))))
+        return false;
+
+    if (!options.errors.empty())
+    {
+        size_t code = static_cast<size_t>(record.errorCode);
+        if (record.errorCode < 0 || code >= options.errors.size() || !options.errors[code])
+            return false;
+    }
+
+    return record.time >= options.from && record.time <= options.to;
+}
+
+void render(const Options& options, const Site* site,
+            const detail::BinaryRecordView& record, Logger::Buffer& out)
+{
+    static const Site UNKNOWN_SITE{true, "<unknown file>", "<unknown function>", "", 0, false};
+
+    if (!site)
+        site = &UNKNOWN_SITE;
+
+    auto time = std::chrono::system_clock::time_point{
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(record.time))
+    };
+
+    std::string_view timestamp = detail::GetThreadTimestampCache().Format(time, options.precision);
+
+    Logger::FormatTextHeader(out, options.colored,
+                             static_cast<Logger::LogType>(record.type),
+                             static_cast<err::ErrorCode>(record.errorCode),
+                             timestamp, site->fileName, site->line, site->functionName);
+
+    if (record.flags & detail::BINARY_RECORD_TRUNCATED)
+    {
+        fmt::format_to(std::back_inserter(out), "<arguments truncated>\n");
+    }
+    else if (site->hasFormat)
+    {
+        size_t start = out.size();
+
+        if (!detail::RenderBinaryMessage(out, site->format, record.args, record.argCount) && out.size() == start)
+            fmt::format_to(std::back_inserter(out), "<corrupted arguments>");
+
+        out.push_back('\n');
+    }
+
+    Logger::FormatTextFooter(out, options.colored, record.suppressed);
+}
+
+void writeOut(Logger::Buffer& out)
+{
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    out.clear();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options{};
+
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    MappedFile file{options.path};
+
+    if (!file)
+    {
+        fmt::print(stderr, "Could not open {}: {}\n", options.path, std::strerror(errno));
+        return 1;
+    }
+
+    detail::BinaryLogReader reader{file.Data(), file.Size()};
+    std::vector<Site> sites;
+    Logger::Buffer out;
+
+    bool headerSeen = false;
+
+    for (;;)
+    {
+        size_t position = reader.Position();
+        detail::BinaryLogReader::Entry entry = reader.Next();
+
+        switch (entry)
+        {
+            case detail::BinaryLogReader::Entry::FILE_HEADER:
+                headerSeen = true;
+                sites.clear();
+                break;
+
+            case detail::BinaryLogReader::Entry::SITE:
+            {
+                const detail::BinarySiteView& view = reader.Site();
+
+                if (sites.size() <= view.siteId)
+                    sites.resize(static_cast<size_t>(view.siteId) + 1);
+
+                sites[view.siteId] = Site{true, std::string{view.fileName}, std::string{view.functionName},
+                                          std::string{view.format}, view.line, view.hasFormat};
+                break;
+            }
+
+            case detail::BinaryLogReader::Entry::RECORD:
+            {
+                const detail::BinaryRecordView& record = reader.Record();
+
+                if (!isSelected(options, record))
+                    break;
+
+                const Site* site = record.siteId < sites.size() && sites[record.siteId].valid
+                                 ? &sites[record.siteId] : nullptr;
+
+                render(options, site, record, out);
+
+                if (out.size() >= OUTPUT_FLUSH_SIZE)
+                    writeOut(out);
+
+                break;
+            }
+
+            case detail::BinaryLogReader::Entry::END:
+                writeOut(out);
+                return 0;
+
+            case detail::BinaryLogReader::Entry::CORRUPTED:
+                writeOut(out);
+                fmt::print(stderr, "{}: {} at offset {}\n", options.path,
+                           headerSeen ? "corrupted entry" : "not a binary mlib log", position);
+                return 2;
+        }
+
+        if (!headerSeen)
+        {
+            writeOut(out);
+            fmt::print(stderr, "{}: not a binary mlib log\n", options.path);
+            return 2;
+        }
+    }
+}
+
+//NOLINTEND